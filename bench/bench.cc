@@ -0,0 +1,675 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+//
+// Benchmarks for the hot paths of the WM, built with -DBUILD_BENCH=ON and run
+// by ctest. Each of them is a subcommand of wmderland_bench:
+//
+//   rules     compiling thousands of rules, and looking them up
+//   tree      inserting, tiling and removing the leaves of a 1000-leaf tree
+//   cookie    the latency of Cookie::Put() while the cookie is being written
+//   snapshot  Snapshot::Save() and Load() with 9 workspaces of 500 windows
+//   adopt     adopting 200 windows which have been mapped before the WM started
+//   clients   filtering and tiling a workspace of 10k clients
+//   alloc     the heap allocations made while arranging the windows, iterating
+//             the clients, and handling an event (needs -DCOUNT_ALLOCATIONS=ON)
+//
+// Those which run a WindowManager need an X server with no other WM on it,
+// e.g., `Xvfb :1 & DISPLAY=:1 ctest`, and are skipped without one. A benchmark
+// fails if the WM doesn't do what it's expected to.
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "query.h"
+#include "tree.h"
+#include "util.h"
+#include "window_manager.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::to_string;
+using std::vector;
+
+namespace wmderland {
+
+class Bench {
+ public:
+  static int RunRules();
+  static int RunTree();
+  static int RunCookie();
+  static int RunSnapshot();
+  static int RunAdopt();
+  static int RunClients();
+  static int RunAlloc();
+
+ private:
+  static const int kSkipped = 77;  // see SKIP_RETURN_CODE in CMakeLists.txt
+
+  static WindowManager* StartWindowManager();
+  static vector<Window> CreateWindows(WindowManager* wm, int count, const string& res_class);
+  static void HandleBatch(WindowManager* wm, const XEvent& event);
+  static bool Check(bool condition, const string& what);
+};
+
+namespace {
+
+string home;
+
+using Clock = std::chrono::steady_clock;
+
+double ElapsedMs(Clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+void WriteFile(const string& filename, const string& data) {
+  std::ofstream fout(filename);
+  fout << data;
+}
+
+int RemovePath(const char* path, const struct stat*, int, struct FTW*) {
+  return remove(path);
+}
+
+// The WM reads and writes everything under $HOME, so each run gets its own.
+void MakeHome() {
+  char dirname[] = "/tmp/wmderland-bench.XXXXXX";
+  if (!mkdtemp(dirname)) {
+    return;
+  }
+
+  home = dirname;
+  mkdir((home + "/.config").c_str(), 0700);
+  mkdir((home + "/.config/wmderland").c_str(), 0700);
+  mkdir((home + "/.cache").c_str(), 0700);
+  mkdir((home + "/.cache/wmderland").c_str(), 0700);
+  setenv("HOME", dirname, /*overwrite=*/1);
+
+  // Registered before the WM (if any) is constructed, so that it runs after
+  // the WM has been destructed.
+  std::atexit([]() { nftw(home.c_str(), &RemovePath, 16, FTW_DEPTH | FTW_PHYS); });
+}
+
+// Tiles the leaves below `node` the same way Workspace::DfsTileHelper() does,
+// except that the leaves need no clients. Returns the number of leaves, and
+// adds up their areas.
+int TileLeaves(Tree::Node* node, int x, int y, int w, int h, long* total_area) {
+  if (node->leaf()) {
+    *total_area += static_cast<long>(w) * h;
+    return 1;
+  }
+
+  double total_ratio = 0.;
+  for (const auto child : node->children()) {
+    total_ratio += child->ratio();
+  }
+
+  const TilingDirection dir = node->tiling_direction();
+  int leaf_count = 0;
+  for (const auto child : node->children()) {
+    const int child_w =
+        (dir == TilingDirection::HORIZONTAL) ? w * child->ratio() / total_ratio : w;
+    const int child_h =
+        (dir == TilingDirection::VERTICAL) ? h * child->ratio() / total_ratio : h;
+    leaf_count += TileLeaves(child, x, y, child_w, child_h, total_area);
+
+    if (dir == TilingDirection::HORIZONTAL) x += child_w;
+    if (dir == TilingDirection::VERTICAL) y += child_h;
+  }
+  return leaf_count;
+}
+
+}  // namespace
+
+
+// Looks up the rules of windows which hit an exact rule, a glob rule, or
+// neither, against a config with kExactRuleCount classes and kGlobRuleCount
+// glob patterns.
+int Bench::RunRules() {
+  static const int kExactRuleCount = 5000;
+  static const int kGlobRuleCount = 500;
+  static const int kLookupCount = 1000000;
+
+  string config;
+  for (int i = 0; i < kExactRuleCount; i++) {
+    config += "assign App" + to_string(i) + " " + to_string(i % WORKSPACE_COUNT + 1) + "\n";
+    config += "floating App" + to_string(i) + ",dialog" + to_string(i) + " true\n";
+  }
+  for (int i = 0; i < kGlobRuleCount; i++) {
+    config += "fullscreen Game" + to_string(i) + "_* true\n";
+  }
+
+  const string filename = home + "/.config/wmderland/config";
+  WriteFile(filename, config);
+
+  auto begin = Clock::now();
+  Config cfg(nullptr, nullptr, filename);
+  cfg.Load();
+  cout << "rules: loaded " << 2 * kExactRuleCount + kGlobRuleCount << " rules in "
+       << ElapsedMs(begin) << "ms" << endl;
+
+  vector<query::WindowInfo> infos(3);
+  infos[0].res_class = "App4321";
+  infos[0].res_name = "dialog4321";
+  infos[1].res_class = "Game123_linux";
+  infos[1].res_name = "game";
+  infos[2].res_class = "URxvt";
+  infos[2].res_name = "urxvt";
+
+  bool ok = true;
+  Config::WindowRules rules = cfg.GetWindowRules(infos[0]);
+  ok &= Check(rules.workspace_id == 4321 % WORKSPACE_COUNT && rules.should_float,
+              "an exact rule applies");
+  rules = cfg.GetWindowRules(infos[1]);
+  ok &= Check(rules.should_fullscreen && !rules.should_float, "a glob rule applies");
+  rules = cfg.GetWindowRules(infos[2]);
+  ok &= Check(rules.workspace_id == UNSPECIFIED_WORKSPACE && !rules.should_fullscreen,
+              "no rule applies");
+
+  const unsigned long allocation_count = sys_utils::GetAllocationCount();
+  int float_count = 0;
+  begin = Clock::now();
+  for (int i = 0; i < kLookupCount; i++) {
+    float_count += cfg.GetWindowRules(infos[i % infos.size()]).should_float;
+  }
+  const double elapsed_ms = ElapsedMs(begin);
+  const unsigned long allocations = sys_utils::GetAllocationCount() - allocation_count;
+
+  cout << "rules: " << kLookupCount << " lookups in " << elapsed_ms << "ms ("
+       << static_cast<long>(kLookupCount / elapsed_ms * 1000) << " lookups/s, "
+       << allocations << " allocations)" << endl;
+  ok &= Check(float_count == (kLookupCount + 2) / 3, "the lookups are consistent");
+  ok &= Check(allocations == 0, "a lookup allocates nothing");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Builds a tree of kLeafCount leaves the way a workspace does, with every
+// kSplitInterval-th leaf split into a container of the other direction (as
+// tile_h/tile_v would), then tiles it, and removes the leaves again (every
+// other leaf first), normalizing the tree after each removal as the WM does.
+// None of these needs an X server.
+int Bench::RunTree() {
+  static const int kLeafCount = 1000;
+  static const int kSplitInterval = 4;
+  static const int kRoundCount = 20;
+  static const int kTileCount = 1000;
+  static const int kWidth = 1920;
+  static const int kHeight = 1080;
+
+  Tree tree;
+  vector<Tree::Node*> leaves;
+  double insert_ms = 0.;
+  double remove_ms = 0.;
+  bool ok = true;
+
+  for (int round = 0; round < kRoundCount; round++) {
+    leaves.clear();
+    auto begin = Clock::now();
+    for (int i = 0; i < kLeafCount; i++) {
+      Tree::NodePtr node = tree.NewNode();
+      Tree::Node* node_raw = node.get();
+      Tree::Node* current_node = tree.current_node();
+
+      if (!current_node) {
+        tree.root_node()->AddChild(std::move(node));
+      } else {
+        if (i % kSplitInterval == 0) {
+          Tree::NodePtr container = tree.NewNode();
+          container->set_tiling_direction(
+              current_node->parent()->tiling_direction() == TilingDirection::HORIZONTAL
+                  ? TilingDirection::VERTICAL
+                  : TilingDirection::HORIZONTAL);
+          current_node->InsertParent(std::move(container));
+        }
+        current_node->parent()->InsertChildAfter(std::move(node), current_node);
+      }
+
+      tree.set_current_node(node_raw);
+      leaves.push_back(node_raw);
+    }
+    insert_ms += ElapsedMs(begin);
+
+    if (round == 0) {
+      long total_area = 0;
+      const unsigned long allocation_count = sys_utils::GetAllocationCount();
+      int leaf_count = 0;
+      begin = Clock::now();
+      for (int i = 0; i < kTileCount; i++) {
+        leaf_count = TileLeaves(tree.root_node(), 0, 0, kWidth, kHeight, &total_area);
+      }
+      const double elapsed_ms = ElapsedMs(begin);
+      const unsigned long allocations = sys_utils::GetAllocationCount() - allocation_count;
+
+      cout << "tree: tiled " << leaf_count << " leaves " << kTileCount << " times in "
+           << elapsed_ms << "ms (" << allocations << " allocations)" << endl;
+      ok &= Check(leaf_count == kLeafCount, "every leaf is tiled");
+      ok &= Check(total_area / kTileCount > 0.9 * kWidth * kHeight &&
+                      total_area / kTileCount <= static_cast<long>(kWidth) * kHeight,
+                  "the leaves cover the screen");
+      ok &= Check(allocations == 0, "tiling allocates nothing");
+    }
+
+    begin = Clock::now();
+    for (int offset = 0; offset < 2; offset++) {
+      for (size_t i = offset; i < leaves.size(); i += 2) {
+        Tree::Node* parent_node = leaves[i]->parent();
+        parent_node->RemoveChild(leaves[i]);
+        while (parent_node->children().empty() && parent_node != tree.root_node()) {
+          Tree::Node* grandparent_node = parent_node->parent();
+          grandparent_node->RemoveChild(parent_node);
+          parent_node = grandparent_node;
+        }
+        tree.Normalize();
+      }
+    }
+    remove_ms += ElapsedMs(begin);
+
+    tree.set_current_node(nullptr);
+    ok &= Check(tree.root_node()->children().empty(), "every leaf is removed");
+  }
+
+  cout << "tree: inserted " << kLeafCount << " leaves in " << insert_ms / kRoundCount
+       << "ms, removed them in " << remove_ms / kRoundCount << "ms" << endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Puts the areas of more windows than the cookie can hold for a few seconds,
+// while the writer thread is stuck writing the cookie file: the file which it
+// writes first is a FIFO which nobody reads until all the Put()s are done.
+int Bench::RunCookie() {
+  static const int kWindowCount = 2 * COOKIE_MAX_ENTRY_COUNT;
+  static const int kPutCount = 10000;
+  static const auto kPutInterval = std::chrono::microseconds(300);
+
+  WindowManager* wm = StartWindowManager();
+  if (!wm) {
+    return kSkipped;
+  }
+
+  const string filename = sys_utils::ToAbsPath(COOKIE_FILE);
+  const string tmp_filename = filename + ".tmp";  // see sys_utils::WriteFileAtomically()
+  mkfifo(tmp_filename.c_str(), 0600);
+
+  vector<Window> windows = CreateWindows(wm, kWindowCount, "Cookie");
+
+  double total_ms = 0.;
+  double max_ms = 0.;
+  for (int i = 0; i < kPutCount; i++) {
+    const Client::Area area(i % 1000, i % 800, 100 + i % 50, 100 + i % 40);
+    const auto begin = Clock::now();
+    wm->cookie_.Put(windows[i % windows.size()], area);
+    const double elapsed_ms = ElapsedMs(begin);
+
+    total_ms += elapsed_ms;
+    max_ms = std::max(max_ms, elapsed_ms);
+    std::this_thread::sleep_for(kPutInterval);
+  }
+
+  cout << "cookie: " << kPutCount << " puts, mean " << total_ms / kPutCount * 1000
+       << "us, max " << max_ms * 1000 << "us" << endl;
+
+  bool ok = true;
+  const Client::Area area = wm->cookie_.Get(windows[(kPutCount - 1) % windows.size()]);
+  ok &= Check(area.x == (kPutCount - 1) % 1000, "the latest area is kept");
+  ok &= Check(access(filename.c_str(), F_OK) == -1, "the writer has been stuck");
+
+  // Let the writer go. It gives up on the FIFO and writes the cookie again.
+  const int fd = open(tmp_filename.c_str(), O_RDONLY | O_NONBLOCK);
+  char buf[BUFSIZ];
+  while (access(tmp_filename.c_str(), F_OK) != -1) {
+    while (read(fd, buf, sizeof(buf)) > 0) {}
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  close(fd);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Saves and loads a snapshot of kWindowCount windows on each workspace.
+int Bench::RunSnapshot() {
+  static const int kWindowCount = 500;
+
+  WindowManager* wm = StartWindowManager();
+  if (!wm) {
+    return kSkipped;
+  }
+
+  vector<Window> windows;
+  for (int i = 0; i < WORKSPACE_COUNT; i++) {
+    wm->current_ = i;
+    for (const auto window : CreateWindows(wm, kWindowCount, "Snapshot" + to_string(i))) {
+      wm->Manage(window, Config::WindowRules());
+      windows.push_back(window);
+    }
+  }
+
+  auto begin = Clock::now();
+  wm->snapshot_.Save();
+  cout << "snapshot: saved " << windows.size() << " windows in " << ElapsedMs(begin) << "ms"
+       << endl;
+
+  for (const auto window : windows) {
+    wm->Unmanage(window);
+  }
+
+  bool ok = true;
+  ok &= Check(Client::mapper_.size() == 0, "all the windows are unmanaged");
+
+  begin = Clock::now();
+  wm->snapshot_.Load();
+  cout << "snapshot: loaded " << Client::mapper_.size() << " windows in " << ElapsedMs(begin)
+       << "ms" << endl;
+
+  ok &= Check(Client::mapper_.size() == windows.size(), "all the windows are restored");
+  for (const auto& workspace : wm->workspaces_) {
+    int count = 0;
+    for (const auto* client : workspace->clients()) {
+      ok &= Check(client->workspace() == workspace.get(), "a client is in its workspace");
+      count++;
+    }
+    ok &= Check(count == kWindowCount, "workspace " + to_string(workspace->id() + 1) +
+                                           " has all of its windows");
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Adopts kWindowCount mapped windows, half of which are assigned to another
+// workspace by a rule, while kUnmappedWindowCount unmapped ones are left alone.
+// The WM forgets what it knows about these windows first, so that it has to
+// fetch all of it as it would at startup.
+int Bench::RunAdopt() {
+  static const int kWindowCount = 200;
+  static const int kUnmappedWindowCount = 20;
+
+  WriteFile(home + "/.config/wmderland/config", "assign AdoptElsewhere 2\n");
+  WindowManager* wm = StartWindowManager();
+  if (!wm) {
+    return kSkipped;
+  }
+
+  const vector<Window> windows = CreateWindows(wm, kWindowCount / 2, "Adopt");
+  const vector<Window> elsewhere_windows =
+      CreateWindows(wm, kWindowCount / 2, "AdoptElsewhere");
+  const vector<Window> unmapped_windows = CreateWindows(wm, kUnmappedWindowCount, "Unmapped");
+  for (const auto* group : {&windows, &elsewhere_windows, &unmapped_windows}) {
+    for (const auto window : *group) {
+      if (group != &unmapped_windows) {
+        XMapWindow(wm->dpy_, window);
+      }
+      query::ForgetWindowInfo(window);
+    }
+  }
+  XSync(wm->dpy_, False);
+
+  auto begin = Clock::now();
+  wm->AdoptWindows();
+  const double adopt_ms = ElapsedMs(begin);
+  begin = Clock::now();
+  wm->ArrangeWindowsIfNeeded();
+  cout << "adopt: adopted " << Client::mapper_.size() << " windows in " << adopt_ms
+       << "ms, and arranged them in " << ElapsedMs(begin) << "ms" << endl;
+
+  // The WM hasn't handled the UnmapNotify events yet, so ask the X server.
+  auto is_viewable = [wm](Window window) {
+    XWindowAttributes attr;
+    return XGetWindowAttributes(wm->dpy_, window, &attr) && attr.map_state == IsViewable;
+  };
+
+  bool ok = true;
+  ok &= Check(Client::mapper_.size() == kWindowCount, "all the mapped windows are adopted");
+  for (const auto window : windows) {
+    const Client* c = Client::mapper_.Find(window);
+    ok &= Check(c && c->workspace() == wm->workspaces_[0].get() && is_viewable(window),
+                "a window is shown on the current workspace");
+  }
+  for (const auto window : elsewhere_windows) {
+    const Client* c = Client::mapper_.Find(window);
+    ok &= Check(c && c->workspace() == wm->workspaces_[1].get() && !is_viewable(window),
+                "a window is hidden on the workspace it is assigned to");
+  }
+  for (const auto window : unmapped_windows) {
+    ok &= Check(!Client::mapper_.Find(window), "an unmapped window is left alone");
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Filters a workspace of kWindowCount clients (one in kTilingInterval tiled,
+// the rest floating) into its tiling and floating ones, and arranges it, which
+// filters them again to map, tile and raise them. No gaps and thin borders, so
+// that each tiled window still gets a few pixels of its own.
+int Bench::RunClients() {
+  static const int kWindowCount = 10000;
+  static const int kTilingInterval = 50;
+  static const int kTilingCount = kWindowCount / kTilingInterval;
+  static const int kRepeatCount = 100;
+
+  WriteFile(home + "/.config/wmderland/config", "set gap_width = 0\nset border_width = 1\n");
+  WindowManager* wm = StartWindowManager();
+  if (!wm) {
+    return kSkipped;
+  }
+
+  const vector<Window> windows = CreateWindows(wm, kWindowCount, "Clients");
+  Workspace* workspace = wm->workspaces_[wm->current_].get();
+  for (size_t i = 0; i < windows.size(); i++) {
+    wm->Manage(windows[i], Config::WindowRules());
+    workspace->GetClient(windows[i])->set_floating(i % kTilingInterval != 0);
+  }
+
+  int tiling_count = 0;
+  int floating_count = 0;
+  auto begin = Clock::now();
+  for (int i = 0; i < kRepeatCount; i++) {
+    for (const auto* client : workspace->tiling_clients()) {
+      tiling_count += client->is_mapped();
+    }
+    for (const auto* client : workspace->floating_clients()) {
+      floating_count += client->is_mapped();
+    }
+  }
+  cout << "clients: filtered " << kWindowCount << " clients in "
+       << ElapsedMs(begin) / kRepeatCount << "ms" << endl;
+
+  wm->ArrangeWindows();
+  wm->ArrangeWindowsIfNeeded();
+  begin = Clock::now();
+  for (int i = 0; i < kRepeatCount; i++) {
+    wm->ArrangeWindows();
+    wm->ArrangeWindowsIfNeeded();
+  }
+  cout << "clients: arranged " << kWindowCount << " clients (" << kTilingCount << " tiled) in "
+       << ElapsedMs(begin) / kRepeatCount << "ms" << endl;
+
+  bool ok = true;
+  ok &= Check(tiling_count == kRepeatCount * kTilingCount, "the tiling clients are filtered");
+  ok &= Check(floating_count == kRepeatCount * (kWindowCount - kTilingCount),
+              "the floating clients are filtered");
+
+  const int screen_width = DisplayWidth(wm->dpy_, DefaultScreen(wm->dpy_));
+  int x = -1;
+  for (auto* client : workspace->tiling_clients()) {
+    const Client::Area geometry = client->GetGeometry();
+    ok &= Check(geometry.x > x && geometry.w > 0 && geometry.x + geometry.w <= screen_width,
+                "the tiled clients are side by side");
+    x = geometry.x;
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Each of these paths is warmed up once, since the containers they reuse
+// may grow the first time, and must not allocate after that.
+int Bench::RunAlloc() {
+#if !COUNT_ALLOCATIONS
+  cout << "alloc: skipped, the WM is built without -DCOUNT_ALLOCATIONS=ON" << endl;
+  return kSkipped;
+#else
+  static const int kWindowCount = 100;
+  static const int kRepeatCount = 100;
+
+  WriteFile(home + "/.config/wmderland/config", "set focus_follows_mouse = true\n");
+  WindowManager* wm = StartWindowManager();
+  if (!wm) {
+    return kSkipped;
+  }
+
+  const vector<Window> windows = CreateWindows(wm, kWindowCount, "Alloc");
+  for (const auto window : windows) {
+    wm->Manage(window, Config::WindowRules());
+  }
+  Workspace* workspace = wm->workspaces_[wm->current_].get();
+  workspace->GetClient(windows[0])->set_floating(true);
+
+  auto count_allocations = [](const std::function<void()>& func) {
+    func();
+    const unsigned long allocation_count = sys_utils::GetAllocationCount();
+    for (int i = 0; i < kRepeatCount; i++) {
+      func();
+    }
+    return sys_utils::GetAllocationCount() - allocation_count;
+  };
+
+  bool ok = true;
+  auto expect_none = [&ok](const string& what, unsigned long allocations) {
+    cout << "alloc: " << what << ": " << allocations << " allocations" << endl;
+    ok &= Check(allocations == 0, what + " allocates nothing");
+  };
+
+  expect_none("arranging " + to_string(kWindowCount) + " windows", count_allocations([wm]() {
+                wm->ArrangeWindows();
+                wm->ArrangeWindowsIfNeeded();
+              }));
+
+  int client_count = 0;
+  expect_none("iterating the clients", count_allocations([&client_count, workspace]() {
+                for (const auto view : {&Workspace::clients, &Workspace::tiling_clients,
+                                         &Workspace::floating_clients}) {
+                  for (auto* client : (workspace->*view)()) {
+                    client_count += client->is_mapped();
+                  }
+                }
+              }));
+  ok &= Check(client_count == (kRepeatCount + 1) * 2 * kWindowCount,
+              "the views cover every client");
+
+  // The events are made up rather than read from the X server, so that
+  // they are handled the same way every time.
+  XEvent event;
+  std::memset(&event, 0, sizeof(event));
+  int i = 0;
+  expect_none("handling an EnterNotify", count_allocations([wm, &windows, &event, &i]() {
+                event.type = EnterNotify;
+                event.xcrossing.window = windows[1 + i++ % 2];
+                event.xcrossing.mode = NotifyNormal;
+                event.xcrossing.serial = NextRequest(wm->dpy_);
+                HandleBatch(wm, event);
+              }));
+  ok &= Check(workspace->GetFocusedClient()->window() == event.xcrossing.window,
+              "the EnterNotify events move the focus");
+
+  expect_none("handling a ConfigureRequest", count_allocations([wm, &windows, &event]() {
+                event.type = ConfigureRequest;
+                event.xconfigurerequest.window = windows[2];
+                event.xconfigurerequest.value_mask = CWWidth | CWHeight;
+                event.xconfigurerequest.width = 640;
+                event.xconfigurerequest.height = 480;
+                HandleBatch(wm, event);
+              }));
+
+  expect_none("handling a PropertyNotify", count_allocations([wm, &windows, &event]() {
+                event.type = PropertyNotify;
+                event.xproperty.window = windows[3];
+                event.xproperty.atom = XA_WM_NAME;
+                event.xproperty.state = PropertyNewValue;
+                HandleBatch(wm, event);
+              }));
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+#endif
+}
+
+// Returns nullptr if there is no X server, or if another WM is running on it.
+WindowManager* Bench::StartWindowManager() {
+  WindowManager* wm = WindowManager::GetInstance();
+  if (!wm) {
+    cout << "skipped, failed to open display to X server" << endl;
+    return nullptr;
+  }
+  if (!WindowManager::is_running_) {
+    cout << "skipped, another window manager is running" << endl;
+    return nullptr;
+  }
+  return wm;
+}
+
+// Creates top-level windows of `res_class` named "<res_class><i>", and fetches
+// their WindowInfo (as the WM would, once they are mapped).
+vector<Window> Bench::CreateWindows(WindowManager* wm, int count, const string& res_class) {
+  vector<Window> windows;
+  for (int i = 0; i < count; i++) {
+    const Window window = XCreateSimpleWindow(wm->dpy_, wm->root_window_, 0, 0, 100, 100, 0,
+                                              0, 0);
+    string res_name = res_class + to_string(i);
+    XClassHint class_hint = {&res_name[0], const_cast<char*>(res_class.c_str())};
+    XSetClassHint(wm->dpy_, window, &class_hint);
+    windows.push_back(window);
+  }
+
+  query::PrefetchWindowInfo(windows);
+  return windows;
+}
+
+// Handles an event the way WindowManager::Run() handles a batch of them.
+void Bench::HandleBatch(WindowManager* wm, const XEvent& event) {
+  wm->HandleXEvent(event);
+  wm->ArrangeWindowsIfNeeded();
+  wm->UpdateClientListIfNeeded();
+  wm->JournalLayoutIfNeeded();
+  wm->event_arena_.Reset();
+}
+
+bool Bench::Check(bool condition, const string& what) {
+  if (!condition) {
+    cerr << "FAILED: " << what << endl;
+  }
+  return condition;
+}
+
+}  // namespace wmderland
+
+
+int main(int argc, char* args[]) {
+  const vector<std::pair<string, std::function<int()>>> benches = {
+      {"rules", &wmderland::Bench::RunRules},
+      {"tree", &wmderland::Bench::RunTree},
+      {"cookie", &wmderland::Bench::RunCookie},
+      {"snapshot", &wmderland::Bench::RunSnapshot},
+      {"adopt", &wmderland::Bench::RunAdopt},
+      {"clients", &wmderland::Bench::RunClients},
+      {"alloc", &wmderland::Bench::RunAlloc},
+  };
+
+  for (const auto& bench : benches) {
+    if (argc == 2 && bench.first == args[1]) {
+      wmderland::MakeHome();
+      return bench.second();
+    }
+  }
+
+  cerr << "usage: " << args[0] << " <rules|tree|cookie|snapshot|adopt|clients|alloc>" << endl;
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,26 @@
+# - Try to find libxcb and libX11-xcb (Xlib/XCB interoperability)
+#
+# The following are set after configuration is done:
+#  XCB_FOUND
+#  XCB_INCLUDE_DIRS
+#  XCB_LIBRARIES
+
+include(FindPackageHandleStandardArgs)
+
+find_path(XCB_INCLUDE_DIR xcb/xcb.h)
+find_path(X11_XCB_INCLUDE_DIR X11/Xlib-xcb.h)
+find_library(XCB_LIBRARY xcb)
+find_library(X11_XCB_LIBRARY X11-xcb)
+
+find_package_handle_standard_args(XCB DEFAULT_MSG
+    XCB_INCLUDE_DIR X11_XCB_INCLUDE_DIR XCB_LIBRARY X11_XCB_LIBRARY)
+
+if(XCB_FOUND)
+    set(XCB_FOUND 1)
+    set(XCB_INCLUDE_DIRS ${XCB_INCLUDE_DIR} ${X11_XCB_INCLUDE_DIR})
+    set(XCB_LIBRARIES ${XCB_LIBRARY} ${X11_XCB_LIBRARY})
+    message(STATUS "Found xcb     (include: ${XCB_INCLUDE_DIRS}, library: ${XCB_LIBRARIES})")
+    mark_as_advanced(XCB_INCLUDE_DIR X11_XCB_INCLUDE_DIR XCB_LIBRARY X11_XCB_LIBRARY)
+else()
+    set(XCB_FOUND 0)
+endif()
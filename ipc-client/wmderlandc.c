@@ -50,6 +50,7 @@ static Command cmd_table[] = {
   {"exit",                     0, ARG_TYPE_NONE},
   {"reload",                   0, ARG_TYPE_NONE},
   {"debug_crash",              0, ARG_TYPE_NONE},
+  {"restart",                  0, ARG_TYPE_NONE},
   {NULL,                       0, ARG_TYPE_NONE}
 };
 
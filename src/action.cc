@@ -91,6 +91,8 @@ Action::Type Action::StrToActionType(const string& s) {
     return Action::Type::RELOAD;
   } else if (s == "debug_crash") {
     return Action::Type::DEBUG_CRASH;
+  } else if (s == "restart") {
+    return Action::Type::RESTART;
   } else if (s == "exec") {
     return Action::Type::EXEC;
   } else {
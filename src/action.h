@@ -36,6 +36,7 @@ class Action {
     EXIT,
     RELOAD,
     DEBUG_CRASH,
+    RESTART,
     EXEC,
     UNDEFINED,
   };
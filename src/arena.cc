@@ -0,0 +1,53 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace wmderland {
+
+Arena::Arena(size_t block_size)
+    : block_size_(block_size), blocks_(), current_block_(), offset_() {}
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+  while (true) {
+    if (current_block_ < blocks_.size()) {
+      Arena::Block& block = blocks_[current_block_];
+      const uintptr_t begin = reinterpret_cast<uintptr_t>(block.data.get());
+      const uintptr_t ptr = (begin + offset_ + alignment - 1) & ~(alignment - 1);
+
+      if (ptr + size <= begin + block.size) {
+        offset_ = ptr + size - begin;
+        return reinterpret_cast<void*>(ptr);
+      }
+
+      // This block is full (or too small for this one), so move on to the next.
+      if (current_block_ + 1 < blocks_.size()) {
+        current_block_++;
+        offset_ = 0;
+        continue;
+      }
+    }
+
+    // Out of blocks. An oversized allocation gets a block of its own size.
+    const size_t block_size = std::max(block_size_, size + alignment);
+    blocks_.push_back({std::make_unique<char[]>(block_size), block_size});
+    current_block_ = blocks_.size() - 1;
+    offset_ = 0;
+  }
+}
+
+void Arena::Reset() {
+  current_block_ = 0;
+  offset_ = 0;
+}
+
+size_t Arena::capacity() const {
+  size_t capacity = 0;
+  for (const auto& block : blocks_) {
+    capacity += block.size;
+  }
+  return capacity;
+}
+
+}  // namespace wmderland
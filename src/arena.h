@@ -0,0 +1,84 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+#ifndef WMDERLAND_ARENA_H_
+#define WMDERLAND_ARENA_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace wmderland {
+
+// A monotonic memory resource for the temporary objects made while handling
+// a batch of events (std::pmr::monotonic_buffer_resource is C++17).
+//
+// Allocating is a pointer bump and deallocating does nothing. Reset() takes
+// back everything at once, but keeps the blocks for the next batch, so after
+// the first few batches the arena doesn't touch the heap anymore.
+class Arena {
+ public:
+  explicit Arena(size_t block_size = kDefaultBlockSize_);
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+  virtual ~Arena() = default;
+
+  void* Allocate(size_t size, size_t alignment);
+  void Reset();
+
+  size_t capacity() const;
+
+ private:
+  static const size_t kDefaultBlockSize_ = 16 * 1024;
+
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  const size_t block_size_;
+  std::vector<Arena::Block> blocks_;
+  size_t current_block_;
+  size_t offset_;  // within the current block
+};
+
+// An allocator which draws from an Arena, so that a standard container can be
+// used as a temporary without allocating from the heap.
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T*, size_t) {}
+
+  Arena* arena() const {
+    return arena_;
+  }
+
+ private:
+  Arena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}  // namespace wmderland
+
+#endif  // WMDERLAND_ARENA_H_
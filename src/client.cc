@@ -2,37 +2,79 @@
 #include "client.h"
 
 #include "config.h"
+#include "query.h"
 #include "util.h"
 #include "workspace.h"
 
 using std::string;
-using std::unordered_map;
 
 namespace wmderland {
 
-unordered_map<Window, Client*> Client::mapper_;
+WindowMap<Client> Client::mapper_;
+unsigned long Client::sent_request_count_[Client::REQUEST_TYPE_SIZE] = {};
+unsigned long Client::suppressed_request_count_[Client::REQUEST_TYPE_SIZE] = {};
+Window Client::top_window_ = None;
+unsigned long Client::last_stacking_order_ = 0;
+
+string Client::GetRequestStats() {
+  static const char* const kRequestNames[REQUEST_TYPE_SIZE] = {
+      "map", "move/resize", "border width", "border color", "raise"};
+
+  string stats;
+  for (int i = 0; i < REQUEST_TYPE_SIZE; i++) {
+    stats += (i == 0) ? "" : ", ";
+    stats += string(kRequestNames[i]) + ": " + std::to_string(sent_request_count_[i]) + "/" +
+             std::to_string(sent_request_count_[i] + suppressed_request_count_[i]);
+  }
+  return stats;
+}
+
+void Client::InvalidateStackingOrder() {
+  top_window_ = None;
+}
+
+unsigned long Client::last_stacking_order() {
+  return last_stacking_order_;
+}
 
 Client::Client(Display* dpy, Window window, Workspace* workspace)
-    : dpy_(dpy),
-      window_(window),
+    : window_(window),
       workspace_(workspace),
-      size_hints_(wm_utils::GetWmNormalHints(window)),
-      attr_cache_(),
+      node_(),
       is_mapped_(),
       is_floating_(),
       is_fullscreen_(),
-      has_unmap_req_from_wm_() {
-  Client::mapper_[window] = this;
+      has_unmap_req_from_wm_(),
+      server_state_(),
+      stacking_order_(++last_stacking_order_),
+      dpy_(dpy),
+      geometry_cache_() {
+  Client::mapper_.Insert(window, this);
   SetBorderWidth(workspace->config()->border_width());
   SetBorderColor(workspace->config()->unfocused_color());
 }
 
 Client::~Client() {
-  Client::mapper_.erase(window_);
+  Client::mapper_.Erase(window_);
+
+  if (top_window_ == window_) {
+    InvalidateStackingOrder();
+  }
 }
 
-void Client::Map() const {
+void Client::Map() {
+  if (server_state_.is_mapped) {
+    suppressed_request_count_[MAP]++;
+    return;
+  }
+
+  sent_request_count_[MAP]++;
+  server_state_.is_mapped = true;
   XMapWindow(dpy_, window_);
+
+  // A newly mapped window is placed on top of its siblings.
+  InvalidateStackingOrder();
+  stacking_order_ = ++last_stacking_order_;
 }
 
 void Client::Unmap() {
@@ -43,66 +85,113 @@ void Client::Unmap() {
   }
 
   has_unmap_req_from_wm_ = true;  // will be set to false in WindowManager::OnUnmapNotify
+  server_state_.is_mapped = false;
   XUnmapWindow(dpy_, window_);
 }
 
-void Client::Raise() const {
-  XRaiseWindow(dpy_, window_);
-}
-
-void Client::Move(int x, int y, bool absolute) const {
-  if (absolute) {
-    XMoveWindow(dpy_, window_, x, y);
+void Client::Raise() {
+  if (top_window_ == window_) {
+    suppressed_request_count_[RAISE]++;
     return;
   }
 
-  XWindowAttributes attr = GetXWindowAttributes();
-  XMoveWindow(dpy_, window_, attr.x + x, attr.y + y);
+  sent_request_count_[RAISE]++;
+  top_window_ = window_;
+  stacking_order_ = ++last_stacking_order_;
+  XRaiseWindow(dpy_, window_);
 }
 
-void Client::Resize(int w, int h, bool absolute) const {
-  if (absolute) {
-    ConstrainSizeIfFloating(w, h);
-    XResizeWindow(dpy_, window_, w, h);
-    return;
-  }
+void Client::Move(int x, int y, bool absolute) {
+  Client::Area geometry = GetGeometry();
 
-  // Resize window by relative width and height.
-  XWindowAttributes attr = GetXWindowAttributes();
-  w = attr.width + w;
-  h = attr.height + h;
-  ConstrainSizeIfFloating(w, h);
-  XResizeWindow(dpy_, window_, w, h);
+  if (!absolute) {
+    x += geometry.x;
+    y += geometry.y;
+  }
+  SendMoveResize(x, y, geometry.w, geometry.h);
 }
 
-void Client::MoveResize(int x, int y, int w, int h, bool absolute) const {
-  if (absolute) {
-    ConstrainSizeIfFloating(w, h);
-    XMoveResizeWindow(dpy_, window_, x, y, w, h);
-    return;
-  }
+void Client::Resize(int w, int h, bool absolute) {
+  Client::Area geometry = GetGeometry();
 
   // Resize window by relative width and height.
-  XWindowAttributes attr = GetXWindowAttributes();
-  w = attr.width + w;
-  h = attr.height + h;
+  if (!absolute) {
+    w += geometry.w;
+    h += geometry.h;
+  }
   ConstrainSizeIfFloating(w, h);
-  XMoveResizeWindow(dpy_, window_, attr.x + x, attr.y + y, w, h);
+  SendMoveResize(geometry.x, geometry.y, w, h);
 }
 
-void Client::MoveResize(int x, int y, const std::pair<int, int>& size) const {
-  XMoveResizeWindow(dpy_, window_, x, y, size.first, size.second);
+void Client::MoveResize(int x, int y, int w, int h, bool absolute) {
+  // Resize window by relative width and height.
+  if (!absolute) {
+    Client::Area geometry = GetGeometry();
+    x += geometry.x;
+    y += geometry.y;
+    w += geometry.w;
+    h += geometry.h;
+  }
+  ConstrainSizeIfFloating(w, h);
+  SendMoveResize(x, y, w, h);
+}
+
+void Client::MoveResize(int x, int y, const std::pair<int, int>& size) {
+  SendMoveResize(x, y, size.first, size.second);
+}
+
+void Client::Configure(const XConfigureRequestEvent& e) {
+  XWindowChanges changes;
+  changes.x = e.x;
+  changes.y = e.y;
+  changes.width = e.width;
+  changes.height = e.height;
+  changes.border_width = e.border_width;
+  changes.sibling = e.above;
+  changes.stack_mode = e.detail;
+  XConfigureWindow(dpy_, window_, e.value_mask, &changes);
+
+  // Keep the shadow in sync with what the client has just requested.
+  if (server_state_.has_geometry) {
+    Client::Area& geometry = server_state_.geometry;
+    geometry.x = (e.value_mask & CWX) ? e.x : geometry.x;
+    geometry.y = (e.value_mask & CWY) ? e.y : geometry.y;
+    geometry.w = (e.value_mask & CWWidth) ? e.width : geometry.w;
+    geometry.h = (e.value_mask & CWHeight) ? e.height : geometry.h;
+  }
+  if (e.value_mask & CWBorderWidth) {
+    server_state_.border_width = e.border_width;
+  }
+  if (e.value_mask & CWStackMode) {
+    InvalidateStackingOrder();
+  }
 }
 
 void Client::SetInputFocus() const {
   XSetInputFocus(dpy_, window_, RevertToParent, CurrentTime);
 }
 
-void Client::SetBorderWidth(unsigned int width) const {
+void Client::SetBorderWidth(unsigned int width) {
+  if (server_state_.has_border_width && server_state_.border_width == width) {
+    suppressed_request_count_[SET_BORDER_WIDTH]++;
+    return;
+  }
+
+  sent_request_count_[SET_BORDER_WIDTH]++;
+  server_state_.border_width = width;
+  server_state_.has_border_width = true;
   XSetWindowBorderWidth(dpy_, window_, width);
 }
 
-void Client::SetBorderColor(unsigned long color) const {
+void Client::SetBorderColor(unsigned long color) {
+  if (server_state_.has_border_color && server_state_.border_color == color) {
+    suppressed_request_count_[SET_BORDER_COLOR]++;
+    return;
+  }
+
+  sent_request_count_[SET_BORDER_COLOR]++;
+  server_state_.border_color = color;
+  server_state_.has_border_color = true;
   XSetWindowBorder(dpy_, window_, color);
 }
 
@@ -114,7 +203,17 @@ XWindowAttributes Client::GetXWindowAttributes() const {
   return wm_utils::GetXWindowAttributes(window_);
 }
 
-void Client::Move(const Action& action) const {
+Client::Area Client::GetGeometry() {
+  // Only ask the X server if we haven't placed this window ourselves yet.
+  if (!server_state_.has_geometry) {
+    XWindowAttributes attr = GetXWindowAttributes();
+    server_state_.geometry = Client::Area(attr.x, attr.y, attr.width, attr.height);
+    server_state_.has_geometry = true;
+  }
+  return server_state_.geometry;
+}
+
+void Client::Move(const Action& action) {
   const int& move_step = workspace_->config()->float_move_step();
   int x_offset = 0;
   int y_offset = 0;
@@ -139,7 +238,7 @@ void Client::Move(const Action& action) const {
   Move(x_offset, y_offset, /*absolute=*/false);
 }
 
-void Client::Resize(const Action& action) const {
+void Client::Resize(const Action& action) {
   const int& resize_step = workspace_->config()->float_resize_step();
   int width_offset = 0;
   int height_offset = 0;
@@ -178,12 +277,16 @@ Workspace* Client::workspace() const {
   return workspace_;
 }
 
-const XSizeHints& Client::size_hints() const {
-  return size_hints_;
+Tree::Node* Client::node() const {
+  return node_;
+}
+
+const Client::Area& Client::geometry_cache() const {
+  return geometry_cache_;
 }
 
-const XWindowAttributes& Client::attr_cache() const {
-  return attr_cache_;
+unsigned long Client::stacking_order() const {
+  return stacking_order_;
 }
 
 bool Client::is_mapped() const {
@@ -206,12 +309,25 @@ void Client::set_workspace(Workspace* workspace) {
   workspace_ = workspace;
 }
 
+void Client::set_node(Tree::Node* node) {
+  node_ = node;
+}
+
 void Client::set_mapped(bool mapped) {
   is_mapped_ = mapped;
+
+  // The client may have unmapped itself.
+  if (!mapped) {
+    server_state_.is_mapped = false;
+  }
 }
 
 void Client::set_floating(bool floating) {
   is_floating_ = floating;
+
+  if (node_) {
+    node_->UpdateLeafCounts();
+  }
 }
 
 void Client::set_fullscreen(bool fullscreen) {
@@ -222,8 +338,8 @@ void Client::set_has_unmap_req_from_wm(bool has_unmap_req_from_wm) {
   has_unmap_req_from_wm_ = has_unmap_req_from_wm;
 }
 
-void Client::set_attr_cache(const XWindowAttributes& attr) {
-  attr_cache_ = attr;
+void Client::set_geometry_cache(const Client::Area& geometry) {
+  geometry_cache_ = geometry;
 }
 
 void Client::ConstrainSizeIfFloating(int& w, int& h) const {
@@ -233,12 +349,35 @@ void Client::ConstrainSizeIfFloating(int& w, int& h) const {
     return;
   }
 
-  const int min_w = (size_hints_.flags & PMinSize) ? size_hints_.min_width : MIN_WINDOW_WIDTH;
-  const int min_h = (size_hints_.flags & PMinSize) ? size_hints_.min_height : MIN_WINDOW_HEIGHT;
+  const XSizeHints& size_hints = query::GetWindowInfo(window_).normal_hints;
+  const int min_w = (size_hints.flags & PMinSize) ? size_hints.min_width : MIN_WINDOW_WIDTH;
+  const int min_h = (size_hints.flags & PMinSize) ? size_hints.min_height : MIN_WINDOW_HEIGHT;
   w = (w < min_w) ? min_w : w;
   h = (h < min_h) ? min_h : h;
 }
 
+void Client::SendMoveResize(int x, int y, int w, int h) {
+  const Client::Area geometry(x, y, w, h);
+  if (server_state_.has_geometry && server_state_.geometry == geometry) {
+    suppressed_request_count_[MOVE_RESIZE]++;
+    return;
+  }
+
+  sent_request_count_[MOVE_RESIZE]++;
+  server_state_.geometry = geometry;
+  server_state_.has_geometry = true;
+  XMoveResizeWindow(dpy_, window_, x, y, w, h);
+}
+
+Client::ServerState::ServerState()
+    : geometry(),
+      border_width(),
+      border_color(),
+      has_geometry(),
+      has_border_width(),
+      has_border_color(),
+      is_mapped() {}
+
 Client::Area::Area() : x(), y(), w(), h() {}
 
 Client::Area::Area(int x, int y, int w, int h) : x(x), y(y), w(w), h(h) {}
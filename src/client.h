@@ -7,8 +7,10 @@ extern "C" {
 #include <X11/Xutil.h>
 }
 #include <string>
-#include <unordered_map>
+
 #include "action.h"
+#include "tree.h"
+#include "window_map.h"
 
 namespace wmderland {
 
@@ -27,32 +29,59 @@ class Client {
     int x, y, w, h;
   };
 
+  // The requests which go through the server-state shadow (see ServerState).
+  enum Request {
+    MAP,
+    MOVE_RESIZE,
+    SET_BORDER_WIDTH,
+    SET_BORDER_COLOR,
+    RAISE,
+    REQUEST_TYPE_SIZE,
+  };
+
   // The lightning fast mapper which maps Window to Client* in O(1)
-  static std::unordered_map<Window, Client*> mapper_;
+  static WindowMap<Client> mapper_;
+
+  // How many requests of each type have been sent, and how many have been
+  // dropped because they wouldn't have changed anything.
+  static unsigned long sent_request_count_[REQUEST_TYPE_SIZE];
+  static unsigned long suppressed_request_count_[REQUEST_TYPE_SIZE];
+  static std::string GetRequestStats();
+
+  // Some other window has been raised or mapped on top of the stack.
+  static void InvalidateStackingOrder();
+
+  // Each time a client is created, mapped or raised, it is given the next
+  // stacking order, so sorting the clients by it yields the stacking order
+  // (from bottom to top) as far as we can tell.
+  static unsigned long last_stacking_order();
 
   Client(Display* dpy, Window window, Workspace* workspace);
   virtual ~Client();
 
-  void Map() const;
+  void Map();
   void Unmap();
-  void Raise() const;
-  void Move(int x, int y, bool absolute = true) const;
-  void Resize(int w, int h, bool absolute = true) const;
-  void MoveResize(int x, int y, int w, int h, bool absolute = true) const;
-  void MoveResize(int x, int y, const std::pair<int, int>& size) const;
+  void Raise();
+  void Move(int x, int y, bool absolute = true);
+  void Resize(int w, int h, bool absolute = true);
+  void MoveResize(int x, int y, int w, int h, bool absolute = true);
+  void MoveResize(int x, int y, const std::pair<int, int>& size);
+  void Configure(const XConfigureRequestEvent& e);
   void SetInputFocus() const;
-  void SetBorderWidth(unsigned int width) const;
-  void SetBorderColor(unsigned long color) const;
+  void SetBorderWidth(unsigned int width);
+  void SetBorderColor(unsigned long color);
   void SelectInput(long input_mask) const;
   XWindowAttributes GetXWindowAttributes() const;
+  Client::Area GetGeometry();
 
-  void Move(const Action& action) const;  // FLOAT_MOVE_{LEFT,RIGHT,UP,DOWN}
-  void Resize(const Action& action) const;  // FLOAT_RESIZE_{LEFT,RIGHT,UP,DOWN}
+  void Move(const Action& action);  // FLOAT_MOVE_{LEFT,RIGHT,UP,DOWN}
+  void Resize(const Action& action);  // FLOAT_RESIZE_{LEFT,RIGHT,UP,DOWN}
 
   Window window() const;
   Workspace* workspace() const;
-  const XSizeHints& size_hints() const;
-  const XWindowAttributes& attr_cache() const;
+  Tree::Node* node() const;
+  const Client::Area& geometry_cache() const;
+  unsigned long stacking_order() const;
 
   bool is_mapped() const;
   bool is_floating() const;
@@ -60,26 +89,54 @@ class Client {
   bool has_unmap_req_from_wm() const;
 
   void set_workspace(Workspace* workspace);
+  void set_node(Tree::Node* node);
   void set_mapped(bool mapped);
   void set_floating(bool floating);
   void set_fullscreen(bool fullscreen);
   void set_has_unmap_req_from_wm(bool has_unmap_req_from_user);
-  void set_attr_cache(const XWindowAttributes& attr);
+  void set_geometry_cache(const Client::Area& geometry);
 
  private:
+  // The state which we've most recently sent to the X server. Requests that
+  // wouldn't change it are dropped.
+  struct ServerState {
+    ServerState();
+
+    Client::Area geometry;
+    unsigned int border_width;
+    unsigned long border_color;
+    bool has_geometry;
+    bool has_border_width;
+    bool has_border_color;
+    bool is_mapped;
+  };
+
+  // The window which we've most recently raised, provided that nothing
+  // has been stacked above it since then.
+  static Window top_window_;
+  static unsigned long last_stacking_order_;
+
   void ConstrainSizeIfFloating(int& w, int& h) const;
+  void SendMoveResize(int x, int y, int w, int h);
 
-  Display* dpy_;
+  // The fields which are read while arranging or iterating over the clients
+  // come first, so that they share the first cache line of a Client. Cold
+  // data such as WM_NORMAL_HINTS isn't kept here at all, but looked up in
+  // the query::WindowInfo cache when needed.
   Window window_;
   Workspace* workspace_;
-  XSizeHints size_hints_;
-  XWindowAttributes attr_cache_;
+  Tree::Node* node_;  // the tree node which holds this client
 
   bool is_mapped_;
   bool is_floating_;
   bool is_fullscreen_;
-
   bool has_unmap_req_from_wm_;
+
+  ServerState server_state_;
+  unsigned long stacking_order_;
+
+  Display* dpy_;
+  Client::Area geometry_cache_;  // saved before dragging or going fullscreen
 };
 
 }  // namespace wmderland
@@ -1,11 +1,13 @@
 // Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
 #include "config.h"
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 
 #include "action.h"
 #include "log.h"
+#include "query.h"
 #include "util.h"
 
 using std::ifstream;
@@ -29,44 +31,46 @@ void Config::Load() {
   fin >> *this;
 }
 
-int Config::GetSpawnWorkspaceId(Window window) const {
-  for (const auto& key : GeneratePossibleConfigKeys(window)) {
-    auto it = spawn_rules_.find(key);
-    if (it != spawn_rules_.end()) {
-      return it->second - 1;  // workspace id starts from 0.
-    }
-  }
-  return UNSPECIFIED_WORKSPACE;
-}
-
-bool Config::ShouldFloat(Window window) const {
-  for (const auto& key : GeneratePossibleConfigKeys(window)) {
-    auto it = float_rules_.find(key);
-    if (it != float_rules_.end()) {
-      return it->second;
+Config::WindowRules Config::GetWindowRules(const query::WindowInfo& info) const {
+  Config::WindowRules rules;
+  unsigned int decided = 0;
+
+  // For each field, the most specific rule wins:
+  // "class,name,title" > "class,name" > "class,title" > "class"
+  auto class_it = rule_index_.find(info.res_class);
+  if (class_it != rule_index_.end()) {
+    const ClassRuleIndex& class_index = class_it->second;
+    auto instance_it = class_index.by_instance.find(info.res_name);
+    if (instance_it != class_index.by_instance.end()) {
+      auto title_it = instance_it->second.by_title.find(info.net_wm_name);
+      if (title_it != instance_it->second.by_title.end()) {
+        title_it->second.MergeInto(&rules, &decided);
+      }
+      instance_it->second.rules.MergeInto(&rules, &decided);
     }
-  }
-  return false;
-}
 
-bool Config::ShouldFullscreen(Window window) const {
-  for (const auto& key : GeneratePossibleConfigKeys(window)) {
-    auto it = fullscreen_rules_.find(key);
-    if (it != fullscreen_rules_.end()) {
-      return it->second;
+    auto title_it = class_index.by_title.find(info.net_wm_name);
+    if (title_it != class_index.by_title.end()) {
+      title_it->second.MergeInto(&rules, &decided);
     }
+    class_index.rules.MergeInto(&rules, &decided);
   }
-  return false;
-}
 
-bool Config::ShouldProhibit(Window window) const {
-  for (const auto& key : GeneratePossibleConfigKeys(window)) {
-    auto it = prohibit_rules_.find(key);
-    if (it != prohibit_rules_.end()) {
-      return it->second;
+  // Then the glob rules, all of them in a single pass over the window's
+  // class, name and title. The matches come in order of precedence.
+  if (!glob_rule_automaton_.empty()) {
+    int state = glob_rule_automaton_.initial_state();
+    state = glob_rule_automaton_.Feed(state, info.res_class);
+    state = glob_rule_automaton_.Feed(state, GlobAutomaton::kSeparator);
+    state = glob_rule_automaton_.Feed(state, info.res_name);
+    state = glob_rule_automaton_.Feed(state, GlobAutomaton::kSeparator);
+    state = glob_rule_automaton_.Feed(state, info.net_wm_name);
+
+    for (const auto id : glob_rule_automaton_.GetMatches(state)) {
+      glob_rules_[id].rules.MergeInto(&rules, &decided);
     }
   }
-  return false;
+  return rules;
 }
 
 const vector<Action>& Config::GetKeybindActions(unsigned int modifier, KeyCode keycode) const {
@@ -77,6 +81,11 @@ const vector<Action>& Config::GetKeybindActions(unsigned int modifier, KeyCode k
   return Config::kEmptyActions_;
 }
 
+const LayoutTemplate* Config::GetLayoutTemplate(int workspace_id) const {
+  auto it = layout_templates_.find(workspace_id);
+  return (it != layout_templates_.end()) ? &it->second : nullptr;
+}
+
 unsigned int Config::gap_width() const {
   return gap_width_;
 }
@@ -113,6 +122,18 @@ bool Config::focus_follows_mouse() const {
   return focus_follows_mouse_;
 }
 
+unsigned int Config::drag_refresh_rate() const {
+  return drag_refresh_rate_;
+}
+
+bool Config::auto_reload() const {
+  return auto_reload_;
+}
+
+const string& Config::filename() const {
+  return filename_;
+}
+
 const map<pair<unsigned int, KeyCode>, vector<Action>>& Config::keybind_rules() const {
   return keybind_rules_;
 }
@@ -140,6 +161,8 @@ Config::Keyword Config::StrToConfigKeyword(const std::string& s) {
     return Config::Keyword::BINDSYM;
   } else if (s == "exec" || s == "exec_on_reload") {
     return Config::Keyword::EXEC;
+  } else if (s == "layout") {
+    return Config::Keyword::LAYOUT;
   } else {
     return Config::Keyword::UNDEFINED;
   }
@@ -152,18 +175,70 @@ string Config::ExtractWindowIdentifier(const std::string& s) {
   return identifier.substr(0, identifier.rfind(' '));
 }
 
-vector<string> Config::GeneratePossibleConfigKeys(Window window) const {
-  pair<string, string> hint = wm_utils::GetXClassHint(window);
-  const string& res_class = hint.first;
-  const string& res_name = hint.second;
-  string net_wm_name = wm_utils::GetNetWmName(window);
-
-  return {
-      res_class + ',' + res_name + ',' + net_wm_name,
-      res_class + ',' + res_name,
-      res_class + ',' + net_wm_name,
-      res_class,
-  };
+// Returns the slots in rule_index_ which the rules for `identifier` should
+// be written to. An identifier is "class", "class,name", "class,title" or
+// "class,name,title". Since "class,name" and "class,title" can't be told
+// apart, such an identifier is compiled as both.
+vector<Config::PartialRules*> Config::CompileWindowIdentifier(const string& identifier) {
+  string::size_type first_comma = identifier.find(',');
+  ClassRuleIndex& class_index = rule_index_[identifier.substr(0, first_comma)];
+  if (first_comma == string::npos) {
+    return {&class_index.rules};
+  }
+
+  const string rest = identifier.substr(first_comma + 1);
+  string::size_type second_comma = rest.find(',');
+  if (second_comma == string::npos) {
+    return {&class_index.by_instance[rest].rules, &class_index.by_title[rest]};
+  }
+
+  // The title itself may contain commas as well.
+  InstanceRuleIndex& instance_index = class_index.by_instance[rest.substr(0, second_comma)];
+  return {&instance_index.by_title[rest.substr(second_comma + 1)],
+          &class_index.by_title[rest]};
+}
+
+// Same as CompileWindowIdentifier(), except that `identifier` contains
+// glob patterns. The fields which are left out match anything.
+void Config::AddGlobRules(const string& identifier, const PartialRules& rules) {
+  static const string kAnyField = "*";
+  const char sep = GlobAutomaton::kSeparator;
+
+  string::size_type first_comma = identifier.find(',');
+  const string res_class = identifier.substr(0, first_comma);
+  if (first_comma == string::npos) {
+    glob_rules_.push_back({res_class + sep + kAnyField + sep + kAnyField, 3, rules});
+    return;
+  }
+
+  const string rest = identifier.substr(first_comma + 1);
+  string::size_type second_comma = rest.find(',');
+  if (second_comma == string::npos) {
+    glob_rules_.push_back({res_class + sep + rest + sep + kAnyField, 1, rules});
+    glob_rules_.push_back({res_class + sep + kAnyField + sep + rest, 2, rules});
+    return;
+  }
+
+  const string res_name = rest.substr(0, second_comma);
+  const string net_wm_name = rest.substr(second_comma + 1);
+  glob_rules_.push_back({res_class + sep + res_name + sep + net_wm_name, 0, rules});
+  glob_rules_.push_back({res_class + sep + kAnyField + sep + rest, 2, rules});
+}
+
+// Sorts the glob rules in order of precedence (the more specific one first,
+// then the one defined later first), and compiles them into one automaton.
+void Config::CompileGlobRules() {
+  std::reverse(glob_rules_.begin(), glob_rules_.end());
+  std::stable_sort(glob_rules_.begin(), glob_rules_.end(),
+                   [](const GlobRule& a, const GlobRule& b) {
+                     return a.specificity < b.specificity;
+                   });
+
+  glob_rule_automaton_.Clear();
+  for (const auto& rule : glob_rules_) {
+    glob_rule_automaton_.Add(rule.pattern);
+  }
+  glob_rule_automaton_.Compile();
 }
 
 const string& Config::ReplaceSymbols(string& s) {
@@ -184,15 +259,16 @@ ifstream& operator>>(ifstream& ifs, Config& config) {
   config.focused_color_ = DEFAULT_FOCUSED_COLOR;
   config.unfocused_color_ = DEFAULT_UNFOCUSED_COLOR;
   config.focus_follows_mouse_ = DEFAULT_FOCUS_FOLLOWS_MOUSE;
+  config.drag_refresh_rate_ = DEFAULT_DRAG_REFRESH_RATE;
+  config.auto_reload_ = DEFAULT_AUTO_RELOAD;
 
   config.symtab_.clear();
-  config.spawn_rules_.clear();
-  config.float_rules_.clear();
-  config.fullscreen_rules_.clear();
-  config.prohibit_rules_.clear();
+  config.rule_index_.clear();
+  config.glob_rules_.clear();
   config.keybind_rules_.clear();
   config.autostart_cmds_.clear();
   config.autostart_cmds_on_reload_.clear();
+  config.layout_templates_.clear();
 
   unordered_map<string, unsigned int> assignable_modifiers = {
       {"Mod1", Mod1Mask},        // Alt
@@ -243,33 +319,54 @@ ifstream& operator>>(ifstream& ifs, Config& config) {
             config.unfocused_color_ = std::stoul(value, nullptr, 16);
           } else if (key == "focus_follows_mouse") {
             stringstream(tokens.back()) >> std::boolalpha >> config.focus_follows_mouse_;
+          } else if (key == "drag_refresh_rate") {
+            // 0 means unlimited, and a negative rate is a mistake.
+            const int rate = std::stoi(value);
+            if (rate < 0) {
+              WM_LOG(ERROR, "config: invalid drag_refresh_rate: " << value);
+            } else {
+              config.drag_refresh_rate_ = std::min(rate, MAX_DRAG_REFRESH_RATE);
+            }
+          } else if (key == "auto_reload") {
+            stringstream(tokens.back()) >> std::boolalpha >> config.auto_reload_;
           } else {
             WM_LOG(ERROR, "config: unrecognized identifier: " << key);
           }
         }
         break;
       }
-      case Config::Keyword::ASSIGN: {
-        string window_identifier = config.ExtractWindowIdentifier(line);
-        config.spawn_rules_[window_identifier] = std::stoi(tokens.back());
-        break;
-      }
-      case Config::Keyword::FLOATING: {
-        string window_identifier = config.ExtractWindowIdentifier(line);
-        stringstream(tokens.back()) >> std::boolalpha >>
-            config.float_rules_[window_identifier];
-        break;
-      }
-      case Config::Keyword::FULLSCREEN: {
-        string window_identifier = config.ExtractWindowIdentifier(line);
-        stringstream(tokens.back()) >> std::boolalpha >>
-            config.fullscreen_rules_[window_identifier];
-        break;
-      }
+      case Config::Keyword::ASSIGN:
+      case Config::Keyword::FLOATING:
+      case Config::Keyword::FULLSCREEN:
       case Config::Keyword::PROHIBIT: {
         string window_identifier = config.ExtractWindowIdentifier(line);
-        stringstream(tokens.back()) >> std::boolalpha >>
-            config.prohibit_rules_[window_identifier];
+        Config::PartialRules rules;
+
+        if (keyword == Config::Keyword::ASSIGN) {
+          // workspace id starts from 0.
+          rules.rules.workspace_id = std::stoi(tokens.back()) - 1;
+          rules.decided = Config::PartialRules::WORKSPACE_ID;
+        } else if (keyword == Config::Keyword::FLOATING) {
+          stringstream(tokens.back()) >> std::boolalpha >> rules.rules.should_float;
+          rules.decided = Config::PartialRules::FLOAT;
+        } else if (keyword == Config::Keyword::FULLSCREEN) {
+          stringstream(tokens.back()) >> std::boolalpha >> rules.rules.should_fullscreen;
+          rules.decided = Config::PartialRules::FULLSCREEN;
+        } else {
+          stringstream(tokens.back()) >> std::boolalpha >> rules.rules.should_prohibit;
+          rules.decided = Config::PartialRules::PROHIBIT;
+        }
+
+        if (window_identifier.find_first_of("*?") != string::npos) {
+          config.AddGlobRules(window_identifier, rules);
+          break;
+        }
+
+        // A later rule overrides an earlier one for the same identifier.
+        for (auto slot : config.CompileWindowIdentifier(window_identifier)) {
+          slot->decided &= ~rules.decided;
+          rules.MergeInto(&slot->rules, &slot->decided);
+        }
         break;
       }
       case Config::Keyword::BINDSYM: {
@@ -303,6 +400,19 @@ ifstream& operator>>(ifstream& ifs, Config& config) {
         }
         break;
       }
+      case Config::Keyword::LAYOUT: {
+        // workspace id starts from 0.
+        LayoutTemplate layout_template;
+        const int workspace_id = (tokens.size() > 2) ? std::stoi(tokens[1]) - 1 : -1;
+
+        if (workspace_id < 0 || workspace_id >= WORKSPACE_COUNT ||
+            !layout_template.Parse(vector<string>(tokens.begin() + 2, tokens.end()))) {
+          WM_LOG(ERROR, "config: invalid layout: " << line);
+          break;
+        }
+        config.layout_templates_[workspace_id] = std::move(layout_template);
+        break;
+      }
       default: {
         WM_LOG(ERROR, "config: unrecognized symbol: " << tokens[0]);
         break;
@@ -310,7 +420,36 @@ ifstream& operator>>(ifstream& ifs, Config& config) {
     }
   }
 
+  config.CompileGlobRules();
   return ifs;
 }
 
+
+Config::WindowRules::WindowRules()
+    : workspace_id(UNSPECIFIED_WORKSPACE),
+      should_float(),
+      should_fullscreen(),
+      should_prohibit() {}
+
+Config::PartialRules::PartialRules() : rules(), decided() {}
+
+// Copies the fields which are decided by these rules but not by `*decided` yet.
+void Config::PartialRules::MergeInto(Config::WindowRules* rules, unsigned int* decided) const {
+  const unsigned int fields = this->decided & ~*decided;
+
+  if (fields & WORKSPACE_ID) {
+    rules->workspace_id = this->rules.workspace_id;
+  }
+  if (fields & FLOAT) {
+    rules->should_float = this->rules.should_float;
+  }
+  if (fields & FULLSCREEN) {
+    rules->should_fullscreen = this->rules.should_fullscreen;
+  }
+  if (fields & PROHIBIT) {
+    rules->should_prohibit = this->rules.should_prohibit;
+  }
+  *decided |= fields;
+}
+
 }  // namespace wmderland
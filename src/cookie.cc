@@ -6,28 +6,40 @@ extern "C" {
 #include <sys/types.h>
 }
 
+#include <iterator>
 #include <sstream>
 #include <vector>
 
 #include "client.h"
+#include "config.h"
+#include "query.h"
 #include "util.h"
 #include "log.h"
 
-using std::endl;
 using std::ifstream;
-using std::ofstream;
-using std::pair;
+using std::lock_guard;
+using std::mutex;
 using std::string;
 using std::stringstream;
-using std::unordered_map;
+using std::unique_lock;
 using std::vector;
 
 namespace wmderland {
 
 const char Cookie::kDelimiter_ = ' ';
+const std::chrono::milliseconds Cookie::kFlushDelay_(1000);
 
 Cookie::Cookie(Display* dpy, Properties* prop, string filename)
-    : dpy_(dpy), prop_(prop), filename_(sys_utils::ToAbsPath(filename)) {
+    : dpy_(dpy),
+      prop_(prop),
+      filename_(sys_utils::ToAbsPath(filename)),
+      entries_(),
+      entry_index_(),
+      mutex_(),
+      cv_(),
+      writer_thread_(),
+      is_dirty_(),
+      is_stopping_() {
 
   // mkdir ~/.cache/wmderland
   string cookie_dirname = filename_.substr(0, filename_.find_last_of('/'));
@@ -40,41 +52,121 @@ Cookie::Cookie(Display* dpy, Properties* prop, string filename)
   fin >> *this;
 }
 
-Client::Area Cookie::Get(Window window) const {
-  auto it = client_area_map_.find(GetCookieKey(window));
-  if (it != client_area_map_.end()) {
-    return it->second;
+Cookie::~Cookie() {
+  // The writer thread writes the pending changes (if any) before it exits.
+  if (writer_thread_.joinable()) {
+    {
+      lock_guard<mutex> lock(mutex_);
+      is_stopping_ = true;
+    }
+    cv_.notify_one();
+    writer_thread_.join();
   }
-  return Client::Area();
+}
+
+Client::Area Cookie::Get(Window window) {
+  const string key = GetCookieKey(window);
+  lock_guard<mutex> lock(mutex_);
+
+  auto it = entry_index_.find(key);
+  if (it == entry_index_.end()) {
+    return Client::Area();
+  }
+
+  // Looking up an entry counts as using it, but doesn't need to be written.
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return it->second->second;
 }
 
 void Cookie::Put(Window window, const Client::Area& area) {
-  client_area_map_[GetCookieKey(window)] = area;
+  const string key = GetCookieKey(window);
+  {
+    lock_guard<mutex> lock(mutex_);
+    Insert(key, area);
+    is_dirty_ = true;
+  }
 
-  // Write cookie to file.
-  ofstream fout(filename_);
-  fout << *this;
+  if (!writer_thread_.joinable()) {
+    writer_thread_ = sys_utils::StartThread([this]() { WriterThreadMain(); });
+  }
+  cv_.notify_one();
 }
 
 string Cookie::GetCookieKey(Window window) const {
-  pair<string, string> hint = wm_utils::GetXClassHint(window);
-  string net_wm_name = wm_utils::GetNetWmName(window);
-  return hint.first + ',' + hint.second + ',' + net_wm_name;
+  const query::WindowInfo& info = query::GetWindowInfo(window);
+  return info.res_class + ',' + info.res_name + ',' + info.net_wm_name;
+}
+
+// Moves the entry of `key` to the front (inserting it if needed), and evicts
+// the least recently used entry if there are too many of them.
+void Cookie::Insert(const string& key, const Client::Area& area) {
+  auto it = entry_index_.find(key);
+  if (it != entry_index_.end()) {
+    it->second->second = area;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return;
+  }
+
+  entries_.emplace_front(key, area);
+  entry_index_.emplace(key, entries_.begin());
+
+  if (entries_.size() > COOKIE_MAX_ENTRY_COUNT) {
+    entry_index_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
 }
 
-ofstream& operator<<(ofstream& ofs, const Cookie& cookie) {
-  for (auto& area : cookie.client_area_map_) {
+string Cookie::Serialize() {
+  lock_guard<mutex> lock(mutex_);
+  return SerializeEntries();
+}
+
+// Replaces all the entries.
+void Cookie::Deserialize(const string& data) {
+  lock_guard<mutex> lock(mutex_);
+  entries_.clear();
+  entry_index_.clear();
+
+  stringstream ss(data);
+  ss >> *this;
+}
+
+string Cookie::SerializeEntries() const {
+  stringstream ss;
+  for (const auto& entry : entries_) {
     // Write x, y, width, height, res_class,res_name,net_wm_name to cookie.
-    ofs << area.second.x << Cookie::kDelimiter_ << area.second.y << Cookie::kDelimiter_
-        << area.second.w << Cookie::kDelimiter_ << area.second.h << Cookie::kDelimiter_
-        << area.first << endl;
+    ss << entry.second.x << kDelimiter_ << entry.second.y << kDelimiter_ << entry.second.w
+       << kDelimiter_ << entry.second.h << kDelimiter_ << entry.first << '\n';
+  }
+  return ss.str();
+}
+
+void Cookie::WriterThreadMain() {
+  unique_lock<mutex> lock(mutex_);
+
+  while (true) {
+    cv_.wait(lock, [this]() { return is_dirty_ || is_stopping_; });
+    if (!is_dirty_) {
+      return;
+    }
+
+    // Give the changes a moment to pile up, unless the WM is exiting.
+    cv_.wait_for(lock, kFlushDelay_, [this]() { return is_stopping_; });
+
+    const string data = SerializeEntries();
+    is_dirty_ = false;
+
+    // Don't hold the lock while writing, so that Get() and Put() never wait
+    // for the disk.
+    lock.unlock();
+    sys_utils::WriteFileAtomically(filename_, data);
+    lock.lock();
   }
-  return ofs;
 }
 
-ifstream& operator>>(ifstream& ifs, Cookie& cookie) {
+std::istream& operator>>(std::istream& is, Cookie& cookie) {
   string line;
-  while (std::getline(ifs, line)) {
+  while (std::getline(is, line)) {
     string_utils::Strip(line);
 
     if (!line.empty()) {
@@ -87,11 +179,16 @@ ifstream& operator>>(ifstream& ifs, Cookie& cookie) {
       stringstream(tokens[2]) >> area.w;
       stringstream(tokens[3]) >> area.h;
 
-      // The rest will be res_class, res_name and _NET_WM_NAME.
-      cookie.client_area_map_[tokens[4]] = area;
+      // The rest will be res_class, res_name and _NET_WM_NAME. The file
+      // lists the most recently used entries first.
+      if (cookie.entries_.size() < COOKIE_MAX_ENTRY_COUNT &&
+          cookie.entry_index_.find(tokens[4]) == cookie.entry_index_.end()) {
+        cookie.entries_.emplace_back(tokens[4], area);
+        cookie.entry_index_.emplace(tokens[4], std::prev(cookie.entries_.end()));
+      }
     }
   }
-  return ifs;
+  return is;
 }
 
 }  // namespace wmderland
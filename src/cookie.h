@@ -5,9 +5,16 @@
 extern "C" {
 #include <X11/Xutil.h>
 }
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
+#include <istream>
+#include <list>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <utility>
 
 #include "client.h"
 
@@ -16,25 +23,51 @@ namespace wmderland {
 class Properties;
 
 // Cookie holds the user-prefered positions and sizes of windows.
+//
+// The cookie file is written behind: Put() only updates the entries in memory
+// and wakes up a writer thread, which waits a moment so that a burst of changes
+// is written only once, then replaces the file atomically. The entries are kept
+// in LRU order, and at most COOKIE_MAX_ENTRY_COUNT of them are kept.
 class Cookie {
  public:
   Cookie(Display* dpy, Properties* prop, const std::string filename);
-  virtual ~Cookie() = default;
+  virtual ~Cookie();
 
-  Client::Area Get(Window window) const;
+  Client::Area Get(Window window);
   void Put(Window window, const Client::Area& area);
 
-  friend std::ofstream& operator<<(std::ofstream& os, const Cookie& cookie);
-  friend std::ifstream& operator>>(std::ifstream& is, Cookie& cookie);
+  // The entries in the format of the cookie file, e.g., for a snapshot.
+  std::string Serialize();
+  void Deserialize(const std::string& data);
+
+  friend std::istream& operator>>(std::istream& is, Cookie& cookie);
 
  private:
+  using Entry = std::pair<std::string, Client::Area>;
+
   static const char kDelimiter_;
+  static const std::chrono::milliseconds kFlushDelay_;
+
   std::string GetCookieKey(Window window) const;
+  void Insert(const std::string& key, const Client::Area& area);
+  std::string SerializeEntries() const;
+
+  void WriterThreadMain();
 
   Display* dpy_;
   Properties* prop_;
   std::string filename_;
-  std::unordered_map<std::string, Client::Area> client_area_map_;
+
+  // The entries from the most recently used to the least recently used, and
+  // an index into them. Guarded by mutex_ once the writer thread is started.
+  std::list<Cookie::Entry> entries_;
+  std::unordered_map<std::string, std::list<Cookie::Entry>::iterator> entry_index_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::thread writer_thread_;
+  bool is_dirty_;
+  bool is_stopping_;
 };
 
 }  // namespace wmderland
@@ -0,0 +1,80 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+#include "event_loop.h"
+
+extern "C" {
+#include <unistd.h>
+}
+#include <cerrno>
+#include <cstring>
+
+#include "log.h"
+
+namespace wmderland {
+
+EventLoop::EventLoop()
+    : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)), callbacks_(), wakeup_count_() {
+  if (epoll_fd_ == -1) {
+    WM_LOG_WITH_ERRNO("epoll_create1() failed", errno);
+  }
+}
+
+EventLoop::~EventLoop() {
+  if (epoll_fd_ != -1) {
+    close(epoll_fd_);
+  }
+}
+
+
+bool EventLoop::Add(int fd, uint32_t events, Callback callback) {
+  if (epoll_fd_ == -1 || fd == -1) {
+    return false;
+  }
+
+  struct epoll_event ev;
+  std::memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == -1) {
+    WM_LOG_WITH_ERRNO("epoll_ctl() failed", errno);
+    return false;
+  }
+
+  callbacks_[fd] = std::move(callback);
+  return true;
+}
+
+void EventLoop::Remove(int fd) {
+  if (callbacks_.erase(fd)) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  }
+}
+
+void EventLoop::Wait() {
+  struct epoll_event events[kMaxEvents_];
+  int n = epoll_wait(epoll_fd_, events, kMaxEvents_, -1);
+  wakeup_count_++;
+
+  if (n == -1) {
+    if (errno != EINTR) {
+      WM_LOG_WITH_ERRNO("epoll_wait() failed", errno);
+    }
+    return;
+  }
+
+  for (int i = 0; i < n; i++) {
+    // A callback may have removed a fd which is also ready in this round, or
+    // even its own fd (hence the copy).
+    auto it = callbacks_.find(events[i].data.fd);
+    if (it != callbacks_.end()) {
+      Callback callback = it->second;
+      callback(events[i].events);
+    }
+  }
+}
+
+unsigned long EventLoop::wakeup_count() const {
+  return wakeup_count_;
+}
+
+}  // namespace wmderland
@@ -0,0 +1,45 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+#ifndef WMDERLAND_EVENT_LOOP_H_
+#define WMDERLAND_EVENT_LOOP_H_
+
+extern "C" {
+#include <sys/epoll.h>
+}
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+namespace wmderland {
+
+// An epoll(7) based event loop. Any file descriptor (the X connection, a
+// timerfd, a signalfd, an inotify instance, a listening socket, etc) can be
+// registered along with a callback which is invoked when it becomes ready.
+//
+// The loop never wakes up by itself, so it doesn't cost anything while idle.
+class EventLoop {
+ public:
+  using Callback = std::function<void(uint32_t events)>;
+
+  EventLoop();
+  virtual ~EventLoop();
+
+  bool Add(int fd, uint32_t events, Callback callback);
+  void Remove(int fd);
+
+  // Blocks until at least one of the registered fds is ready,
+  // then invokes the callbacks of all ready fds.
+  void Wait();
+
+  unsigned long wakeup_count() const;
+
+ private:
+  static const int kMaxEvents_ = 16;
+
+  int epoll_fd_;
+  std::unordered_map<int, Callback> callbacks_;
+  unsigned long wakeup_count_;
+};
+
+}  // namespace wmderland
+
+#endif  // WMDERLAND_EVENT_LOOP_H_
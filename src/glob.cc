@@ -0,0 +1,272 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+#include "glob.h"
+
+#include <algorithm>
+
+#include "config.h"
+#include "log.h"
+
+using std::string;
+using std::vector;
+
+namespace wmderland {
+
+const char GlobAutomaton::kSeparator;
+const int GlobAutomaton::kDeadState;
+const int GlobAutomaton::kNfaState_ = -1;
+const int GlobAutomaton::kNoTransition_ = -1;
+
+GlobAutomaton::GlobAutomaton()
+    : nfa_(),
+      nfa_initial_states_(),
+      pattern_count_(),
+      initial_state_(kDeadState),
+      char_classes_(),
+      char_class_count_(),
+      char_class_samples_(),
+      dfa_nfa_states_(),
+      dfa_transitions_(),
+      dfa_matches_(),
+      dfa_index_(),
+      nfa_states_(),
+      next_nfa_states_(),
+      nfa_state_marks_(),
+      nfa_state_mark_(),
+      nfa_matches_() {
+  Compile();
+}
+
+void GlobAutomaton::Clear() {
+  nfa_.clear();
+  nfa_initial_states_.clear();
+  pattern_count_ = 0;
+  Compile();
+}
+
+int GlobAutomaton::Add(const string& pattern) {
+  nfa_initial_states_.push_back(nfa_.size());
+
+  for (const auto c : pattern) {
+    switch (c) {
+      case '*':
+        nfa_.push_back({ANY_STRING, '\0', -1});
+        break;
+      case '?':
+        nfa_.push_back({ANY_CHAR, '\0', -1});
+        break;
+      case kSeparator:
+        nfa_.push_back({SEPARATOR, '\0', -1});
+        break;
+      default:
+        nfa_.push_back({LITERAL, c, -1});
+        break;
+    }
+  }
+
+  nfa_.push_back({ACCEPT, '\0', pattern_count_});
+  return pattern_count_++;
+}
+
+// Discards the DFA built so far, and builds it again from the current patterns.
+void GlobAutomaton::Compile() {
+  // Class 0 holds the characters which no pattern mentions, and class 1 holds
+  // kSeparator. Each of the other characters has a class of its own.
+  char_classes_.assign(256, 0);
+  char_classes_[static_cast<unsigned char>(kSeparator)] = 1;
+  char_class_count_ = 2;
+  for (const auto& nfa_state : nfa_) {
+    int& char_class = char_classes_[static_cast<unsigned char>(nfa_state.c)];
+    if (nfa_state.type == LITERAL && char_class == 0) {
+      char_class = char_class_count_++;
+    }
+  }
+
+  char_class_samples_.assign(char_class_count_, -1);
+  for (int c = 0; c < 256; c++) {
+    if (char_class_samples_[char_classes_[c]] == -1) {
+      char_class_samples_[char_classes_[c]] = c;
+    }
+  }
+
+  nfa_states_.clear();
+  nfa_states_.reserve(nfa_.size());
+  next_nfa_states_.clear();
+  next_nfa_states_.reserve(nfa_.size());
+  nfa_state_marks_.assign(nfa_.size(), 0);
+  nfa_state_mark_ = 0;
+  nfa_matches_.clear();
+  nfa_matches_.reserve(pattern_count_);
+
+  dfa_nfa_states_.clear();
+  dfa_transitions_.clear();
+  dfa_matches_.clear();
+  dfa_index_.clear();
+
+  GetDfaState(vector<int>());  // kDeadState
+
+  vector<int> nfa_states;
+  ClearNfaStates(&nfa_states);
+  for (const auto i : nfa_initial_states_) {
+    AddNfaState(i, &nfa_states);
+  }
+  std::sort(nfa_states.begin(), nfa_states.end());
+  initial_state_ = GetDfaState(std::move(nfa_states));
+
+  // Every DFA state appended by GetDfaState() is visited by this loop as well.
+  bool truncated = false;
+  for (size_t state = initial_state_; state < dfa_nfa_states_.size(); state++) {
+    for (int char_class = 0; char_class < char_class_count_; char_class++) {
+      const int c = char_class_samples_[char_class];
+      if (c == -1) {
+        continue;
+      }
+
+      StepNfa(dfa_nfa_states_[state], c, &nfa_states);
+      std::sort(nfa_states.begin(), nfa_states.end());
+
+      int next_state = kNoTransition_;
+      auto it = dfa_index_.find(nfa_states);
+      if (it != dfa_index_.end()) {
+        next_state = it->second;
+      } else if (dfa_nfa_states_.size() < GLOB_MAX_DFA_STATE_COUNT) {
+        next_state = GetDfaState(std::move(nfa_states));
+      } else {
+        truncated = true;
+      }
+      dfa_transitions_[state * char_class_count_ + char_class] = next_state;
+    }
+  }
+
+  if (truncated) {
+    WM_LOG(INFO, "glob rules need more than " << GLOB_MAX_DFA_STATE_COUNT
+                                              << " DFA states, the rest are simulated");
+  }
+}
+
+int GlobAutomaton::Feed(int state, char c) const {
+  if (state == kNfaState_) {
+    StepNfa(nfa_states_, c, &next_nfa_states_);
+    nfa_states_.swap(next_nfa_states_);
+  } else {
+    const int char_class = char_classes_[static_cast<unsigned char>(c)];
+    const int next_state = dfa_transitions_[state * char_class_count_ + char_class];
+    if (next_state != kNoTransition_) {
+      return next_state;
+    }
+    StepNfa(dfa_nfa_states_[state], c, &nfa_states_);
+  }
+
+  if (nfa_states_.empty()) {
+    return kDeadState;
+  }
+  return kNfaState_;
+}
+
+int GlobAutomaton::Feed(int state, const string& s) const {
+  for (size_t i = 0; i < s.size() && state != kDeadState; i++) {
+    state = Feed(state, s[i]);
+  }
+  return state;
+}
+
+const vector<int>& GlobAutomaton::GetMatches(int state) const {
+  if (state != kNfaState_) {
+    return dfa_matches_[state];
+  }
+
+  nfa_matches_.clear();
+  for (const auto i : nfa_states_) {
+    if (nfa_[i].type == ACCEPT) {
+      nfa_matches_.push_back(nfa_[i].pattern_id);
+    }
+  }
+  std::sort(nfa_matches_.begin(), nfa_matches_.end());
+  return nfa_matches_;
+}
+
+int GlobAutomaton::initial_state() const {
+  return initial_state_;
+}
+
+bool GlobAutomaton::empty() const {
+  return pattern_count_ == 0;
+}
+
+// Starts a new set of NFA states. Each NFA state is added to it at most once,
+// so it never outgrows the capacity reserved by Compile().
+void GlobAutomaton::ClearNfaStates(vector<int>* nfa_states) const {
+  nfa_states->clear();
+  if (++nfa_state_mark_ == 0) {
+    std::fill(nfa_state_marks_.begin(), nfa_state_marks_.end(), 0);
+    nfa_state_mark_ = 1;
+  }
+}
+
+void GlobAutomaton::StepNfa(const vector<int>& from, char c, vector<int>* to) const {
+  ClearNfaStates(to);
+
+  for (const auto i : from) {
+    const NfaState& nfa_state = nfa_[i];
+
+    switch (nfa_state.type) {
+      case LITERAL:
+        if (c == nfa_state.c) {
+          AddNfaState(i + 1, to);
+        }
+        break;
+      case ANY_CHAR:
+        if (c != kSeparator) {
+          AddNfaState(i + 1, to);
+        }
+        break;
+      case ANY_STRING:
+        if (c != kSeparator) {
+          AddNfaState(i, to);
+        }
+        break;
+      case SEPARATOR:
+        if (c == kSeparator) {
+          AddNfaState(i + 1, to);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+// '*' may match an empty string, so the state after it is reachable as well.
+void GlobAutomaton::AddNfaState(int i, vector<int>* nfa_states) const {
+  for (; nfa_state_marks_[i] != nfa_state_mark_; i++) {
+    nfa_state_marks_[i] = nfa_state_mark_;
+    nfa_states->push_back(i);
+    if (nfa_[i].type != ANY_STRING) {
+      break;
+    }
+  }
+}
+
+int GlobAutomaton::GetDfaState(vector<int>&& nfa_states) {
+  auto it = dfa_index_.find(nfa_states);
+  if (it != dfa_index_.end()) {
+    return it->second;
+  }
+
+  // The NFA states are sorted, so are the pattern ids.
+  vector<int> matches;
+  for (const auto i : nfa_states) {
+    if (nfa_[i].type == ACCEPT) {
+      matches.push_back(nfa_[i].pattern_id);
+    }
+  }
+
+  const int state = dfa_nfa_states_.size();
+  dfa_transitions_.resize(dfa_transitions_.size() + char_class_count_, kDeadState);
+
+  dfa_index_.emplace(nfa_states, state);
+  dfa_nfa_states_.push_back(std::move(nfa_states));
+  dfa_matches_.push_back(std::move(matches));
+  return state;
+}
+
+}  // namespace wmderland
@@ -0,0 +1,98 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+#ifndef WMDERLAND_GLOB_H_
+#define WMDERLAND_GLOB_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace wmderland {
+
+// A set of glob patterns compiled into one automaton, so that matching a string
+// against all of them costs time proportional to the length of the string
+// rather than the number of patterns.
+//
+// In a pattern, '*' matches any sequence of characters and '?' matches any
+// single character, except kSeparator, which only matches itself. This allows
+// a pattern to describe several fields of a record at once, e.g.,
+// "Steam\x1f*\x1fsteam_app_*".
+//
+// The patterns are compiled into an NFA, and then into a DFA by Compile(), so
+// feeding the automaton is a table lookup per character and never allocates.
+// If the DFA would have more than GLOB_MAX_DFA_STATE_COUNT states, the rest of
+// it is left out, and the input which reaches there is matched by simulating
+// the NFA instead (in buffers allocated by Compile() as well). As such, only
+// one input may be matched at a time.
+class GlobAutomaton {
+ public:
+  static const char kSeparator = '\x1f';
+  static const int kDeadState = 0;
+
+  GlobAutomaton();
+  virtual ~GlobAutomaton() = default;
+
+  void Clear();
+  int Add(const std::string& pattern);  // returns the id of this pattern
+  void Compile();
+
+  int Feed(int state, char c) const;
+  int Feed(int state, const std::string& s) const;
+
+  // The ids of the patterns which match all the input fed so far, in
+  // ascending order.
+  const std::vector<int>& GetMatches(int state) const;
+
+  int initial_state() const;
+  bool empty() const;
+
+ private:
+  enum NfaStateType {
+    LITERAL,
+    ANY_CHAR,    // '?'
+    ANY_STRING,  // '*'
+    SEPARATOR,
+    ACCEPT,
+  };
+
+  struct NfaState {
+    NfaStateType type;
+    char c;          // LITERAL only
+    int pattern_id;  // ACCEPT only
+  };
+
+  static const int kNfaState_;      // the current NFA states are in nfa_states_ instead
+  static const int kNoTransition_;  // the target DFA state has been left out
+
+  void ClearNfaStates(std::vector<int>* nfa_states) const;
+  void StepNfa(const std::vector<int>& from, char c, std::vector<int>* to) const;
+  void AddNfaState(int i, std::vector<int>* nfa_states) const;
+  int GetDfaState(std::vector<int>&& nfa_states);
+
+  std::vector<NfaState> nfa_;
+  std::vector<int> nfa_initial_states_;
+  int pattern_count_;
+  int initial_state_;
+
+  // Characters which no pattern mentions behave the same way, so the DFA
+  // transitions are indexed by char_classes_[c] rather than by c itself.
+  std::vector<int> char_classes_;
+  int char_class_count_;
+  std::vector<int> char_class_samples_;  // a character of each class, or -1
+
+  // Each DFA state is a set of NFA states.
+  std::vector<std::vector<int>> dfa_nfa_states_;
+  std::vector<int> dfa_transitions_;  // dfa_transitions_[state * char_class_count_ + class]
+  std::vector<std::vector<int>> dfa_matches_;
+  std::map<std::vector<int>, int> dfa_index_;
+
+  // Scratch space for simulating the NFA, reserved by Compile().
+  mutable std::vector<int> nfa_states_;
+  mutable std::vector<int> next_nfa_states_;
+  mutable std::vector<unsigned> nfa_state_marks_;
+  mutable unsigned nfa_state_mark_;
+  mutable std::vector<int> nfa_matches_;
+};
+
+}  // namespace wmderland
+
+#endif  // WMDERLAND_GLOB_H_
@@ -31,14 +31,13 @@ void IpcEventManager::Handle(const XClientMessageEvent& e) const {
   }
 
 
+  // The argument is a number, which fits in the string's own buffer.
   IpcEvent ipc_event(e);
-  Action action(ipc_event.actionType);
-
   if (ipc_event.has_argument) {
-    action = Action(ipc_event.actionType, std::to_string(ipc_event.argument));
+    wm->HandleAction(Action(ipc_event.actionType, std::to_string(ipc_event.argument)));
+  } else {
+    wm->HandleAction(Action(ipc_event.actionType));
   }
-
-  wm->HandleAction(action);
 }
 
 }  // namespace wmderland
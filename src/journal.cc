@@ -0,0 +1,401 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+#include "journal.h"
+
+extern "C" {
+#include <X11/Xatom.h>
+#include <fcntl.h>
+#include <unistd.h>
+}
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "client.h"
+#include "log.h"
+#include "query.h"
+#include "util.h"
+#include "window_manager.h"
+
+using std::ifstream;
+using std::lock_guard;
+using std::mutex;
+using std::string;
+using std::unique_lock;
+using std::vector;
+
+namespace {
+
+string ReadFile(const string& filename) {
+  ifstream fin(filename, std::ios::binary);
+  return string((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+}
+
+uint64_t GetRandomId() {
+  std::random_device random_device;
+  uint64_t id = 0;
+  while (!id) {
+    id = static_cast<uint64_t>(random_device()) << 32 | random_device();
+  }
+  return id;
+}
+
+}  // namespace
+
+namespace wmderland {
+
+const uint32_t Journal::kVersion_ = 1;
+const size_t Journal::kCheckpointSize_ = 64 * 1024;
+const size_t Journal::kRecordHeaderSize_ = sizeof(uint32_t) + sizeof(uint64_t);
+
+Journal::Journal(Display* dpy, Properties* prop, const string& filename)
+    : dpy_(dpy),
+      prop_(prop),
+      checkpoint_filename_(sys_utils::ToAbsPath(filename) + ".checkpoint"),
+      log_filename_(sys_utils::ToAbsPath(filename) + ".log"),
+      session_id_(),
+      epoch_(GetRandomId()),
+      sequence_(),
+      log_size_(),
+      has_checkpoint_(),
+      images_(),
+      current_(),
+      image_writer_(),
+      record_writer_(),
+      mutex_(),
+      cv_(),
+      pending_writes_(),
+      is_stopping_(),
+      writer_thread_(),
+      log_fd_(-1) {}
+
+Journal::~Journal() {
+  // The writer thread writes the pending records (if any) before it exits.
+  if (writer_thread_.joinable()) {
+    {
+      lock_guard<mutex> lock(mutex_);
+      is_stopping_ = true;
+    }
+    cv_.notify_one();
+    writer_thread_.join();
+  }
+
+  if (log_fd_ != -1) {
+    close(log_fd_);
+  }
+}
+
+// Rebuilds the workspaces from the last checkpoint plus the records logged
+// after it. Returns false if there's no journal of this X session.
+bool Journal::Recover() {
+  WindowManager* wm = WindowManager::GetInstance();
+
+  // 1. The checkpoint holds the images of all workspaces.
+  const string checkpoint = ReadFile(checkpoint_filename_);
+  size_t offset = 0;
+  const char* payload = nullptr;
+  uint32_t payload_size = 0;
+
+  if (!ParseRecord(checkpoint, &offset, &payload, &payload_size)) {
+    return false;
+  }
+
+  // The images are kept as pointers into the files until they are restored.
+  std::array<std::pair<const char*, size_t>, WORKSPACE_COUNT> images;
+  uint32_t current = 0;
+  uint64_t epoch = 0;
+  uint64_t sequence = 0;
+  string log;
+
+  try {
+    SnapshotReader reader(payload, payload_size);
+    epoch = reader.Read<uint64_t>();
+    sequence = reader.Read<uint64_t>();
+    const uint32_t version = reader.Read<uint32_t>();
+    const uint64_t session_id = reader.Read<uint64_t>();
+    current = reader.Read<uint32_t>();
+    const uint32_t image_count = reader.Read<uint32_t>();
+
+    if (version != kVersion_ || session_id != GetSessionId() ||
+        image_count != WORKSPACE_COUNT) {
+      return false;
+    }
+
+    for (auto& image : images) {
+      image.second = reader.Read<uint32_t>();
+      image.first = reader.ReadBytes(image.second);
+    }
+
+    // 2. Replay the log up to the first torn record. The records which
+    // precede the checkpoint or come from another run are skipped.
+    log = ReadFile(log_filename_);
+    offset = 0;
+
+    while (ParseRecord(log, &offset, &payload, &payload_size)) {
+      SnapshotReader record_reader(payload, payload_size);
+      const uint64_t record_epoch = record_reader.Read<uint64_t>();
+      const uint64_t record_sequence = record_reader.Read<uint64_t>();
+      if (record_epoch != epoch || record_sequence <= sequence) {
+        continue;
+      }
+      sequence = record_sequence;
+
+      current = record_reader.Read<uint32_t>();
+      for (uint32_t i = 0, count = record_reader.Read<uint32_t>(); i < count; i++) {
+        const uint32_t id = record_reader.Read<uint32_t>();
+        const uint32_t size = record_reader.Read<uint32_t>();
+        if (id >= WORKSPACE_COUNT) {
+          return false;
+        }
+        images[id] = {record_reader.ReadBytes(size), size};
+      }
+    }
+
+    if (current >= WORKSPACE_COUNT) {
+      return false;
+    }
+
+    // 3. Rebuild the workspaces.
+    for (size_t i = 0; i < WORKSPACE_COUNT; i++) {
+      RestoreImage(wm->workspaces_[i].get(), images[i].first, images[i].second);
+    }
+  } catch (const Snapshot::SnapshotLoadError&) {
+    WM_LOG(ERROR, "Failed to recover from the journal");
+    return false;
+  }
+
+  // 4. The windows which have been destroyed since then are unmanaged.
+  vector<Window> windows;
+  vector<query::WindowAttributesCookie> cookies;
+  for (const auto& win_client_pair : Client::mapper_) {
+    windows.push_back(win_client_pair.first);
+  }
+  cookies.reserve(windows.size());
+  for (const auto window : windows) {
+    cookies.emplace_back(window);
+  }
+  for (size_t i = 0; i < windows.size(); i++) {
+    if (cookies[i].Get().root == None) {  // the window doesn't exist anymore
+      wm->Unmanage(windows[i]);
+    }
+  }
+
+  wm->GotoWorkspace(current);
+  wm->ArrangeWindows();
+  WM_LOG(INFO, "recovered " << Client::mapper_.size() << " clients from the journal");
+  return true;
+}
+
+// Logs the workspaces which have changed since the last record, or takes a new
+// checkpoint if it's time to.
+void Journal::Record(const Journal::Workspaces& workspaces, int current) {
+  const bool is_checkpoint = !has_checkpoint_ || log_size_ >= kCheckpointSize_;
+
+  record_writer_.Clear();
+  record_writer_.Write<uint64_t>(epoch_);
+  record_writer_.Write<uint64_t>(sequence_ + 1);
+  if (is_checkpoint) {
+    record_writer_.Write<uint32_t>(kVersion_);
+    record_writer_.Write<uint64_t>(GetSessionId());
+  }
+  record_writer_.Write<uint32_t>(current);
+
+  // The number of images is filled in afterwards.
+  const size_t image_count_offset = record_writer_.data().size();
+  uint32_t image_count = 0;
+  record_writer_.Write<uint32_t>(image_count);
+
+  for (size_t i = 0; i < WORKSPACE_COUNT; i++) {
+    WriteImage(workspaces[i].get(), &image_writer_);
+    const string& image = image_writer_.data();
+    if (!is_checkpoint && image == images_[i]) {
+      continue;
+    }
+    images_[i] = image;
+
+    if (!is_checkpoint) {
+      record_writer_.Write<uint32_t>(i);
+    }
+    record_writer_.Write<uint32_t>(image.size());
+    record_writer_.WriteBytes(image.data(), image.size());
+    image_count++;
+  }
+
+  if (!is_checkpoint && !image_count && current == current_) {
+    return;
+  }
+  sequence_++;
+  current_ = current;
+
+  record_writer_.Overwrite<uint32_t>(image_count_offset, image_count);
+  Append(is_checkpoint, record_writer_);
+  has_checkpoint_ = true;
+}
+
+// Called when the WM exits normally, so that the next WM starts afresh.
+void Journal::Discard() {
+  if (writer_thread_.joinable()) {
+    {
+      lock_guard<mutex> lock(mutex_);
+      is_stopping_ = true;
+    }
+    cv_.notify_one();
+    writer_thread_.join();
+  }
+
+  unlink(checkpoint_filename_.c_str());
+  unlink(log_filename_.c_str());
+}
+
+// A record is its payload size, the checksum of its payload, and its payload.
+bool Journal::ParseRecord(const string& file, size_t* offset, const char** payload,
+                          uint32_t* payload_size) {
+  if (file.size() - *offset < kRecordHeaderSize_) {
+    return false;
+  }
+
+  uint64_t checksum = 0;
+  std::memcpy(payload_size, file.data() + *offset, sizeof(*payload_size));
+  std::memcpy(&checksum, file.data() + *offset + sizeof(*payload_size), sizeof(checksum));
+
+  if (*payload_size > file.size() - *offset - kRecordHeaderSize_) {
+    return false;
+  }
+
+  *payload = file.data() + *offset + kRecordHeaderSize_;
+  if (Snapshot::GetChecksum(*payload, *payload_size) != checksum) {
+    return false;
+  }
+
+  *offset += kRecordHeaderSize_ + *payload_size;
+  return true;
+}
+
+// The session id is kept on the root window, which lives as long as the X session.
+uint64_t Journal::GetSessionId() {
+  if (session_id_) {
+    return session_id_;
+  }
+
+  const Window root_window = DefaultRootWindow(dpy_);
+  query::PropertyCookie cookie(root_window, prop_->wmderland_session, XA_CARDINAL, 2);
+  const vector<unsigned long>& values = cookie.values();
+
+  if (values.size() == 2) {
+    session_id_ =
+        static_cast<uint64_t>(values[0] & 0xffffffff) << 32 | (values[1] & 0xffffffff);
+  }
+
+  if (!session_id_) {
+    session_id_ = GetRandomId();
+    unsigned long data[2] = {session_id_ >> 32, session_id_ & 0xffffffff};
+    XChangeProperty(dpy_, root_window, prop_->wmderland_session, XA_CARDINAL, 32,
+                    PropModeReplace, reinterpret_cast<unsigned char*>(data), 2);
+  }
+  return session_id_;
+}
+
+// An image is the clients of a workspace (with their states) and its client tree.
+void Journal::WriteImage(const Workspace* workspace, SnapshotWriter* writer) const {
+  writer->Clear();
+
+  // The number of clients is filled in afterwards.
+  uint32_t client_count = 0;
+  writer->Write<uint32_t>(client_count);
+  for (const auto client : workspace->clients()) {
+    writer->Write<uint64_t>(client->window());
+    writer->Write<uint8_t>(Snapshot::GetClientFlags(client));
+    client_count++;
+  }
+
+  workspace->Serialize(writer);
+  writer->Overwrite<uint32_t>(0, client_count);
+}
+
+void Journal::RestoreImage(Workspace* workspace, const char* image, size_t size) const {
+  WindowManager* wm = WindowManager::GetInstance();
+  SnapshotReader reader(image, size);
+
+  for (uint32_t i = 0, client_count = reader.Read<uint32_t>(); i < client_count; i++) {
+    const Window window = reader.Read<uint64_t>();
+    const uint8_t flags = reader.Read<uint8_t>();
+
+    // The ownership of these client objects will be claimed during
+    // client tree deserialization. See Tree::Deserialize() in tree.cc
+    Client* client = new Client(wm->dpy_, window, workspace);
+    Snapshot::RestoreClientFlags(client, flags);
+    wm->client_list_.push_back(window);
+    wm->is_client_list_dirty_ = true;
+
+    if (client->is_fullscreen()) {
+      workspace->set_fullscreen(true);
+    }
+  }
+
+  workspace->Deserialize(&reader);
+}
+
+void Journal::Append(bool is_checkpoint, const SnapshotWriter& payload) {
+  const uint32_t payload_size = payload.data().size();
+  const uint64_t checksum = Snapshot::GetChecksum(payload.data().data(), payload_size);
+
+  string record;
+  record.reserve(kRecordHeaderSize_ + payload_size);
+  record.append(reinterpret_cast<const char*>(&payload_size), sizeof(payload_size));
+  record.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+  record += payload.data();
+
+  log_size_ = is_checkpoint ? 0 : log_size_ + record.size();
+  {
+    lock_guard<mutex> lock(mutex_);
+    pending_writes_.push_back({is_checkpoint, std::move(record)});
+  }
+
+  if (!writer_thread_.joinable()) {
+    writer_thread_ = sys_utils::StartThread([this]() { WriterThreadMain(); });
+  }
+  cv_.notify_one();
+}
+
+void Journal::WriterThreadMain() {
+  log_fd_ = open(log_filename_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (log_fd_ == -1) {
+    WM_LOG_WITH_ERRNO("open() failed", errno);
+  }
+
+  unique_lock<mutex> lock(mutex_);
+  std::deque<Journal::PendingWrite> writes;
+
+  while (true) {
+    cv_.wait(lock, [this]() { return !pending_writes_.empty() || is_stopping_; });
+    if (pending_writes_.empty()) {
+      return;
+    }
+
+    // Don't hold the lock while writing, so that Record() never waits for the disk.
+    writes.swap(pending_writes_);
+    lock.unlock();
+
+    for (const auto& write : writes) {
+      if (write.is_checkpoint) {
+        // The records logged so far are older than the new checkpoint.
+        if (sys_utils::WriteFileAtomically(checkpoint_filename_, write.data) &&
+            log_fd_ != -1 && ftruncate(log_fd_, 0) == -1) {
+          WM_LOG_WITH_ERRNO("ftruncate() failed", errno);
+        }
+      } else if (log_fd_ != -1) {
+        sys_utils::WriteAll(log_fd_, write.data.data(), write.data.size());
+      }
+    }
+    writes.clear();
+
+    if (log_fd_ != -1 && fdatasync(log_fd_) == -1) {
+      WM_LOG_WITH_ERRNO("fdatasync() failed", errno);
+    }
+    lock.lock();
+  }
+}
+
+}  // namespace wmderland
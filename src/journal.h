@@ -0,0 +1,103 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+#ifndef WMDERLAND_JOURNAL_H_
+#define WMDERLAND_JOURNAL_H_
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "config.h"
+#include "snapshot.h"
+#include "workspace.h"
+
+namespace wmderland {
+
+class Properties;
+
+// A write-ahead journal of the layout, from which the WM can rebuild all the
+// workspaces after it has been killed or has crashed without writing a snapshot.
+//
+// The journal consists of a checkpoint file, which holds the image (clients
+// and client tree) of every workspace, and an append-only log. After each batch
+// of events which has changed the layout, one record holding the new images of
+// the workspaces which have changed is appended to the log, so the changes of
+// a batch (e.g., moving a window to another workspace) are never torn apart.
+// Once the log has grown past kCheckpointSize_, a new checkpoint is taken and
+// the log starts over.
+//
+// Every record carries the epoch (one per run of the WM) and sequence number
+// of the journal, and a checksum, so a torn record at the end of the log or
+// a record older than the checkpoint is ignored during recovery. The files are
+// written (and synced) by a writer thread, so the event loop never waits for
+// the disk.
+//
+// Window ids are only meaningful within one X session, so the journal is only
+// recovered if the root window still carries the session id it was written in.
+class Journal {
+ public:
+  using Workspaces = std::array<std::unique_ptr<Workspace>, WORKSPACE_COUNT>;
+
+  Journal(Display* dpy, Properties* prop, const std::string& filename);
+  virtual ~Journal();
+
+  bool Recover();
+  void Record(const Journal::Workspaces& workspaces, int current);
+  void Discard();
+
+ private:
+  // A checkpoint or log record, ready to be written.
+  struct PendingWrite {
+    bool is_checkpoint;
+    std::string data;
+  };
+
+  static const uint32_t kVersion_;
+  static const size_t kCheckpointSize_;
+  static const size_t kRecordHeaderSize_;
+
+  static bool ParseRecord(const std::string& file, size_t* offset, const char** payload,
+                          uint32_t* payload_size);
+
+  uint64_t GetSessionId();
+  void WriteImage(const Workspace* workspace, SnapshotWriter* writer) const;
+  void RestoreImage(Workspace* workspace, const char* image, size_t size) const;
+  void Append(bool is_checkpoint, const SnapshotWriter& payload);
+  void WriterThreadMain();
+
+  Display* dpy_;
+  Properties* prop_;
+  const std::string checkpoint_filename_;
+  const std::string log_filename_;
+  uint64_t session_id_;
+
+  // The state of the journal as seen by the event loop.
+  uint64_t epoch_;
+  uint64_t sequence_;
+  size_t log_size_;
+  bool has_checkpoint_;
+  std::array<std::string, WORKSPACE_COUNT> images_;  // as of the last record
+  int current_;
+  SnapshotWriter image_writer_;
+  SnapshotWriter record_writer_;
+
+  // Shared with the writer thread, guarded by mutex_.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Journal::PendingWrite> pending_writes_;
+  bool is_stopping_;
+  std::thread writer_thread_;
+  int log_fd_;  // only touched by the writer thread
+};
+
+}  // namespace wmderland
+
+#endif  // WMDERLAND_JOURNAL_H_
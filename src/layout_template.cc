@@ -0,0 +1,102 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+#include "layout_template.h"
+
+#include "query.h"
+
+using std::string;
+using std::vector;
+
+namespace wmderland {
+
+LayoutTemplate::LayoutTemplate() : nodes_(), slot_count_() {}
+
+bool LayoutTemplate::Parse(const vector<string>& tokens) {
+  Clear();
+  vector<int> open_splits;
+
+  for (const auto& token : tokens) {
+    if (token.empty()) {
+      continue;
+    }
+
+    if (token == "]") {
+      if (open_splits.empty() || nodes_[open_splits.back()].children.empty()) {
+        Clear();
+        return false;
+      }
+      open_splits.pop_back();
+      continue;
+    }
+
+    // The root must be a split, and everything else must be inside one.
+    const bool is_split = token == "h[" || token == "v[";
+    if (nodes_.empty() ? !is_split : open_splits.empty()) {
+      Clear();
+      return false;
+    }
+
+    const int parent = open_splits.empty() ? -1 : open_splits.back();
+    if (is_split) {
+      nodes_.emplace_back(parent, (token == "h[") ? TilingDirection::HORIZONTAL
+                                                  : TilingDirection::VERTICAL);
+      open_splits.push_back(nodes_.size() - 1);
+    } else {
+      const string::size_type comma = token.find(',');
+      nodes_.emplace_back(parent, TilingDirection::UNSPECIFIED);
+      nodes_.back().res_class = token.substr(0, comma);
+      nodes_.back().res_name = (comma == string::npos) ? "" : token.substr(comma + 1);
+      slot_count_++;
+    }
+
+    if (parent != -1) {
+      nodes_[parent].children.push_back(nodes_.size() - 1);
+    }
+  }
+
+  if (nodes_.empty() || !open_splits.empty()) {
+    Clear();
+    return false;
+  }
+
+  for (auto& node : nodes_) {
+    for (const auto child : node.children) {
+      nodes_[child].ratio = 1. / node.children.size();
+    }
+  }
+  return true;
+}
+
+void LayoutTemplate::Clear() {
+  nodes_.clear();
+  slot_count_ = 0;
+}
+
+bool LayoutTemplate::Matches(int slot, const query::WindowInfo& info) const {
+  const LayoutTemplate::Node& node = nodes_[slot];
+  return node.tiling_direction == TilingDirection::UNSPECIFIED &&
+      node.res_class == info.res_class &&
+      (node.res_name.empty() || node.res_name == info.res_name);
+}
+
+const vector<LayoutTemplate::Node>& LayoutTemplate::nodes() const {
+  return nodes_;
+}
+
+int LayoutTemplate::slot_count() const {
+  return slot_count_;
+}
+
+bool LayoutTemplate::empty() const {
+  return nodes_.empty();
+}
+
+
+LayoutTemplate::Node::Node(int parent, TilingDirection tiling_direction)
+    : parent(parent),
+      children(),
+      tiling_direction(tiling_direction),
+      ratio(1.),
+      res_class(),
+      res_name() {}
+
+}  // namespace wmderland
@@ -0,0 +1,56 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+#ifndef WMDERLAND_LAYOUT_TEMPLATE_H_
+#define WMDERLAND_LAYOUT_TEMPLATE_H_
+
+#include <string>
+#include <vector>
+
+#include "tree.h"
+
+namespace wmderland {
+
+namespace query {
+struct WindowInfo;
+}  // namespace query
+
+// The skeleton of a workspace's client tree, declared in the config, e.g.,
+//
+//   layout 3 h[ Firefox v[ URxvt URxvt,weechat ] ]
+//
+// where "h[" and "v[" open a horizontal and a vertical split, "]" closes one,
+// and every other token is a slot reserved for a window of "res_class" or
+// "res_class,res_name". The children of a split share it equally.
+class LayoutTemplate {
+ public:
+  struct Node {
+    Node(int parent, TilingDirection tiling_direction);
+
+    int parent;  // -1 for the root
+    std::vector<int> children;
+    TilingDirection tiling_direction;  // UNSPECIFIED for a slot
+    double ratio;
+    std::string res_class;  // slots only
+    std::string res_name;   // slots only, empty matches any res_name
+  };
+
+  LayoutTemplate();
+  virtual ~LayoutTemplate() = default;
+
+  // Returns false (and leaves the template empty) on a syntax error.
+  bool Parse(const std::vector<std::string>& tokens);
+  void Clear();
+
+  bool Matches(int slot, const query::WindowInfo& info) const;
+
+  const std::vector<LayoutTemplate::Node>& nodes() const;  // nodes()[0] is the root
+  int slot_count() const;
+  bool empty() const;
+
+ private:
+  std::vector<LayoutTemplate::Node> nodes_;
+  int slot_count_;
+};
+
+}  // namespace wmderland
+
+#endif  // WMDERLAND_LAYOUT_TEMPLATE_H_
@@ -2,9 +2,12 @@
 extern "C" {
 #include <unistd.h>
 }
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <string>
 
 #include "log.h"
 #include "snapshot.h"
@@ -12,8 +15,12 @@ extern "C" {
 #include "util.h"
 #include "window_manager.h"
 
+using std::string;
+
 namespace {
 
+const char* kStateFdOption = "--state-fd";
+
 const char* version() {
   return WIN_MGR_NAME " " VERSION "\n"
       "Copyright (C) 2018-2020 Marco Wang <m.aesophor@gmail.com>\n"
@@ -29,6 +36,11 @@ int main(int argc, char* args[]) {
     return EXIT_SUCCESS;
   }
 
+  // If the WM has been restarted in place, the previous process has passed
+  // its state to us as "--state-fd <fd>" (-1 if it has failed to save it).
+  const bool is_restarted = argc > 2 && !std::strcmp(args[1], ::kStateFdOption);
+  const int state_fd = is_restarted ? std::atoi(args[2]) : -1;
+
   // Install segv handler which writes stacktrace to a log upon segfault.
   // See stacktrace.cc
   wmderland::segv::InstallHandler(&wmderland::segv::Handle);
@@ -50,13 +62,38 @@ int main(int argc, char* args[]) {
   }
 
   try {
-    // Try to perform error recovery from the snapshot if necessary and
-    // possible.
-    if (wm->snapshot().FileExists()) {
+    // After a restart, adopt the windows of the previous process, whose
+    // autostart programs are still running. Otherwise, try to perform error
+    // recovery from the snapshot if necessary and possible. If the previous WM
+    // has been killed or has crashed, rebuild the layout from its journal.
+    if (is_restarted && state_fd != -1 && wm->snapshot().LoadFromFd(state_fd)) {
+      WM_LOG(INFO, "restarted in place");
+    } else if (!is_restarted && wm->snapshot().FileExists()) {
       wm->snapshot().Load();
+    } else {
+      wm->journal().Recover();
+    }
+
+    // Manage whatever else is already on the screen.
+    wm->AdoptWindows();
+
+    if (!is_restarted) {
+      wm->Autostart();
     }
     wm->Run();  // enter main event loop
 
+    // Hand the state over to a new process, which may be running a newly
+    // installed binary.
+    if (wm->is_restarting()) {
+      const string fd = std::to_string(wm->snapshot().SaveToMemfd());
+      wm.reset();
+
+      if (execlp(args[0], args[0], ::kStateFdOption, fd.c_str(), nullptr) == -1) {
+        WM_LOG_WITH_ERRNO("execlp() failed", errno);
+        return EXIT_FAILURE;
+      }
+    }
+
   } catch (const std::bad_alloc& ex) {
     static_cast<void>(fputs("Out of memory\n", stderr));
     return EXIT_FAILURE;
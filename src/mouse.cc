@@ -1,12 +1,39 @@
 // Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
 #include "mouse.h"
 
+extern "C" {
+#include <sys/timerfd.h>
+#include <unistd.h>
+}
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include "log.h"
+
 namespace wmderland {
 
-Mouse::Mouse(Display* dpy, Window root_window) : dpy_(dpy), root_window_(root_window) {
+Mouse::Mouse(Display* dpy, Window root_window)
+    : dpy_(dpy),
+      root_window_(root_window),
+      btn_pressed_event_(),
+      btn_motion_event_(),
+      has_pending_motion_(),
+      drag_timer_fd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+      is_drag_timer_armed_() {
   cursors_[CursorType::NORMAL] = XCreateFontCursor(dpy, XC_left_ptr);
   cursors_[CursorType::MOVE] = XCreateFontCursor(dpy, XC_fleur);
   cursors_[CursorType::RESIZE] = XCreateFontCursor(dpy, XC_sizing);
+
+  if (drag_timer_fd_ == -1) {
+    WM_LOG_WITH_ERRNO("timerfd_create() failed", errno);
+  }
+}
+
+Mouse::~Mouse() {
+  if (drag_timer_fd_ != -1) {
+    close(drag_timer_fd_);
+  }
 }
 
 
@@ -14,4 +41,59 @@ void Mouse::SetCursor(Mouse::CursorType type) const {
   XDefineCursor(dpy_, root_window_, cursors_[type]);
 }
 
+void Mouse::ArmDragTimer(unsigned int refresh_rate) {
+  if (drag_timer_fd_ == -1 || refresh_rate == 0) {
+    return;
+  }
+
+  // A zero period would disarm the timer instead.
+  const long period_ns = 1000000000L / refresh_rate;
+  if (period_ns == 0) {
+    return;
+  }
+
+  // A one-shot timer. It is re-armed only if there's another motion event
+  // waiting when it expires, so it won't keep waking us up while the pointer
+  // stays still.
+  struct itimerspec spec;
+  std::memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = period_ns / 1000000000L;
+  spec.it_value.tv_nsec = period_ns % 1000000000L;
+
+  if (timerfd_settime(drag_timer_fd_, 0, &spec, nullptr) == -1) {
+    WM_LOG_WITH_ERRNO("timerfd_settime() failed", errno);
+    return;
+  }
+  is_drag_timer_armed_ = true;
+}
+
+void Mouse::DisarmDragTimer() {
+  if (!is_drag_timer_armed_) {
+    return;
+  }
+
+  struct itimerspec spec;
+  std::memset(&spec, 0, sizeof(spec));
+  timerfd_settime(drag_timer_fd_, 0, &spec, nullptr);
+  is_drag_timer_armed_ = false;
+}
+
+// Returns true if the drag timer has expired since the last call.
+bool Mouse::ConsumeDragTimerExpiration() {
+  uint64_t expirations = 0;
+  if (read(drag_timer_fd_, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+    return false;
+  }
+  is_drag_timer_armed_ = false;
+  return expirations > 0;
+}
+
+int Mouse::drag_timer_fd() const {
+  return drag_timer_fd_;
+}
+
+bool Mouse::is_drag_timer_armed() const {
+  return is_drag_timer_armed_;
+}
+
 }  // namespace wmderland
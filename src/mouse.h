@@ -12,7 +12,7 @@ namespace wmderland {
 class Mouse {
  public:
   Mouse(Display* dpy, Window root_window);
-  virtual ~Mouse() = default;
+  virtual ~Mouse();
 
   enum Button {
     LEFT = 1,
@@ -28,12 +28,25 @@ class Mouse {
 
   void SetCursor(Mouse::CursorType type) const;
 
+  // The drag timer caps how often a floating window being dragged is
+  // moved/resized. `refresh_rate` is in Hz.
+  void ArmDragTimer(unsigned int refresh_rate);
+  void DisarmDragTimer();
+  bool ConsumeDragTimerExpiration();
+  int drag_timer_fd() const;
+  bool is_drag_timer_armed() const;
+
  private:
   Display* dpy_;
   Window root_window_;
 
   Cursor cursors_[4];
   XButtonEvent btn_pressed_event_;  // window move/resize event cache
+  XButtonEvent btn_motion_event_;   // the latest motion event which hasn't been applied yet
+  bool has_pending_motion_;
+
+  int drag_timer_fd_;
+  bool is_drag_timer_armed_;
 
   friend class WindowManager;
 };
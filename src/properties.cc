@@ -5,6 +5,7 @@ namespace wmderland {
 
 Properties::Properties(Display* dpy) : utf8string(XInternAtom(dpy, "UTF8_STRING", false)) {
   wmderland_client_event = XInternAtom(dpy, "WMDERLAND_CLIENT_EVENT", false);
+  wmderland_session = XInternAtom(dpy, "_WMDERLAND_SESSION", false);
 
   wm[atom::WM_PROTOCOLS] = XInternAtom(dpy, "WM_PROTOCOLS", false);
   wm[atom::WM_DELETE_WINDOW] = XInternAtom(dpy, "WM_DELETE_WINDOW", false);
@@ -19,6 +20,7 @@ Properties::Properties(Display* dpy) : utf8string(XInternAtom(dpy, "UTF8_STRING"
   net[atom::NET_DESKTOP_VIEWPORT] = XInternAtom(dpy, "_NET_DESKTOP_VIEWPORT", false);
   net[atom::NET_DESKTOP_NAMES] = XInternAtom(dpy, "_NET_DESKTOP_NAMES", false);
   net[atom::NET_WM_NAME] = XInternAtom(dpy, "_NET_WM_NAME", false);
+  net[atom::NET_WM_PID] = XInternAtom(dpy, "_NET_WM_PID", false);
   net[atom::NET_WM_STATE] = XInternAtom(dpy, "_NET_WM_STATE", false);
   net[atom::NET_WM_STATE_FULLSCREEN] = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", false);
   net[atom::NET_WM_WINDOW_TYPE] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", false);
@@ -30,6 +32,7 @@ Properties::Properties(Display* dpy) : utf8string(XInternAtom(dpy, "UTF8_STRING"
   net[atom::NET_WM_WINDOW_TYPE_NOTIFICATION] =
       XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_NOTIFICATION", false);
   net[atom::NET_CLIENT_LIST] = XInternAtom(dpy, "_NET_CLIENT_LIST", false);
+  net[atom::NET_CLIENT_LIST_STACKING] = XInternAtom(dpy, "_NET_CLIENT_LIST_STACKING", false);
 };
 
 }  // namespace wmderland
@@ -30,6 +30,7 @@ enum {
   NET_DESKTOP_VIEWPORT,
   NET_DESKTOP_NAMES,
   NET_WM_NAME,
+  NET_WM_PID,
   NET_WM_STATE,
   NET_WM_STATE_FULLSCREEN,
   NET_WM_WINDOW_TYPE,
@@ -39,6 +40,7 @@ enum {
   NET_WM_WINDOW_TYPE_UTILITY,
   NET_WM_WINDOW_TYPE_NOTIFICATION,
   NET_CLIENT_LIST,
+  NET_CLIENT_LIST_STACKING,
   NET_ATOM_SIZE,
 };
 
@@ -48,6 +50,7 @@ struct Properties {
   Properties(Display* dpy);
   Atom utf8string;
   Atom wmderland_client_event;  // TODO: implement wmderland event manager
+  Atom wmderland_session;       // see Journal
   Atom wm[atom::WM_ATOM_SIZE];
   Atom net[atom::NET_ATOM_SIZE];
 };
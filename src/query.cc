@@ -0,0 +1,431 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+#include "query.h"
+
+extern "C" {
+#include <X11/Xatom.h>
+#if XCB_FOUND
+#include <X11/Xlib-xcb.h>
+#endif
+}
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace {
+Display* dpy;
+wmderland::Properties* prop;
+#if XCB_FOUND
+xcb_connection_t* conn;
+#endif
+
+// The number of elements in a WM_NORMAL_HINTS property.
+// See ICCCM 4.1.2.3 and Xlib's XGetWMNormalHints().
+const int kOldNumPropSizeElements = 15;  // pre-ICCCM
+const int kNumPropSizeElements = 18;     // ICCCM version 1
+}  // namespace
+
+namespace wmderland {
+
+namespace query {
+
+void Init(Display* dpy, Properties* prop) {
+  ::dpy = dpy;
+  ::prop = prop;
+#if XCB_FOUND
+  // Xlib still owns the event queue. We only borrow its connection to send
+  // requests and collect their replies.
+  ::conn = XGetXCBConnection(dpy);
+#endif
+}
+
+
+WindowAttributesCookie::WindowAttributesCookie(Window window)
+    : window_(window), attr_(), collected_() {
+#if XCB_FOUND
+  attr_cookie_ = xcb_get_window_attributes(conn, window);
+  geometry_cookie_ = xcb_get_geometry(conn, window);
+#endif
+}
+
+WindowAttributesCookie::WindowAttributesCookie(WindowAttributesCookie&& other)
+    : window_(other.window_), attr_(other.attr_), collected_(other.collected_) {
+#if XCB_FOUND
+  attr_cookie_ = other.attr_cookie_;
+  geometry_cookie_ = other.geometry_cookie_;
+#endif
+  other.collected_ = true;  // the replies now belong to this cookie.
+}
+
+WindowAttributesCookie::~WindowAttributesCookie() {
+#if XCB_FOUND
+  // If nobody is interested in the replies, tell xcb to drop them as they arrive.
+  if (!collected_) {
+    xcb_discard_reply(conn, attr_cookie_.sequence);
+    xcb_discard_reply(conn, geometry_cookie_.sequence);
+  }
+#endif
+}
+
+const XWindowAttributes& WindowAttributesCookie::Get() {
+  if (collected_) {
+    return attr_;
+  }
+  collected_ = true;
+
+#if XCB_FOUND
+  xcb_get_window_attributes_reply_t* attr =
+      xcb_get_window_attributes_reply(conn, attr_cookie_, nullptr);
+  xcb_get_geometry_reply_t* geometry = xcb_get_geometry_reply(conn, geometry_cookie_, nullptr);
+
+  if (attr) {
+    attr_.c_class = attr->_class;
+    attr_.bit_gravity = attr->bit_gravity;
+    attr_.win_gravity = attr->win_gravity;
+    attr_.backing_store = attr->backing_store;
+    attr_.backing_planes = attr->backing_planes;
+    attr_.backing_pixel = attr->backing_pixel;
+    attr_.save_under = attr->save_under;
+    attr_.colormap = attr->colormap;
+    attr_.map_installed = attr->map_is_installed;
+    attr_.map_state = attr->map_state;
+    attr_.all_event_masks = attr->all_event_masks;
+    attr_.your_event_mask = attr->your_event_mask;
+    attr_.do_not_propagate_mask = attr->do_not_propagate_mask;
+    attr_.override_redirect = attr->override_redirect;
+    free(attr);
+  }
+
+  if (geometry) {
+    attr_.root = geometry->root;
+    attr_.x = geometry->x;
+    attr_.y = geometry->y;
+    attr_.width = geometry->width;
+    attr_.height = geometry->height;
+    attr_.border_width = geometry->border_width;
+    attr_.depth = geometry->depth;
+    free(geometry);
+  }
+#else
+  XGetWindowAttributes(dpy, window_, &attr_);
+#endif
+  return attr_;
+}
+
+
+PropertyCookie::PropertyCookie(Window window, Atom property, Atom type, long long_length)
+    : window_(window),
+      property_(property),
+      type_(type),
+      long_length_(long_length),
+      collected_(),
+      exists_(),
+      bytes_(),
+      values_() {
+#if XCB_FOUND
+  cookie_ = xcb_get_property(conn, false, window, property, type, 0, long_length);
+#endif
+}
+
+PropertyCookie::PropertyCookie(PropertyCookie&& other)
+    : window_(other.window_),
+      property_(other.property_),
+      type_(other.type_),
+      long_length_(other.long_length_),
+      collected_(other.collected_),
+      exists_(other.exists_),
+      bytes_(std::move(other.bytes_)),
+      values_(std::move(other.values_)) {
+#if XCB_FOUND
+  cookie_ = other.cookie_;
+#endif
+  other.collected_ = true;  // the reply now belongs to this cookie.
+}
+
+PropertyCookie::~PropertyCookie() {
+#if XCB_FOUND
+  if (!collected_) {
+    xcb_discard_reply(conn, cookie_.sequence);
+  }
+#endif
+}
+
+bool PropertyCookie::Get() {
+  if (collected_) {
+    return exists_;
+  }
+  collected_ = true;
+
+#if XCB_FOUND
+  xcb_get_property_reply_t* reply = xcb_get_property_reply(conn, cookie_, nullptr);
+  if (!reply) {
+    return exists_;
+  }
+
+  // If the property doesn't exist, its type will be None. If the types
+  // mismatch, no data will be returned.
+  if (reply->type != XCB_NONE && (type_ == AnyPropertyType || reply->type == type_)) {
+    exists_ = true;
+    const void* data = xcb_get_property_value(reply);
+    int len = xcb_get_property_value_length(reply);
+
+    switch (reply->format) {
+      case 8:
+        bytes_.assign(static_cast<const char*>(data), len);
+        break;
+      case 16:
+        values_.assign(static_cast<const uint16_t*>(data),
+                       static_cast<const uint16_t*>(data) + len / 2);
+        break;
+      case 32:
+        values_.assign(static_cast<const uint32_t*>(data),
+                       static_cast<const uint32_t*>(data) + len / 4);
+        break;
+      default:
+        break;
+    }
+  }
+  free(reply);
+#else
+  Atom actual_type = None;
+  int format = 0;
+  unsigned long nitems = 0;
+  unsigned long remain = 0;
+  unsigned char* data = nullptr;
+
+  if (XGetWindowProperty(dpy, window_, property_, 0, long_length_, False, type_, &actual_type,
+                         &format, &nitems, &remain, &data) != Success) {
+    return exists_;
+  }
+
+  if (actual_type != None && (type_ == AnyPropertyType || actual_type == type_) && data) {
+    exists_ = true;
+
+    // Note that Xlib returns 16-bit data as shorts and 32-bit data as longs.
+    switch (format) {
+      case 8:
+        bytes_.assign(reinterpret_cast<const char*>(data), nitems);
+        break;
+      case 16:
+        values_.assign(reinterpret_cast<const unsigned short*>(data),
+                       reinterpret_cast<const unsigned short*>(data) + nitems);
+        break;
+      case 32:
+        values_.assign(reinterpret_cast<const unsigned long*>(data),
+                       reinterpret_cast<const unsigned long*>(data) + nitems);
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (data) {
+    XFree(data);
+  }
+#endif
+  return exists_;
+}
+
+const string& PropertyCookie::bytes() {
+  Get();
+  return bytes_;
+}
+
+const vector<unsigned long>& PropertyCookie::values() {
+  Get();
+  return values_;
+}
+
+
+namespace {
+
+std::unordered_map<Window, WindowInfo> window_info_cache;
+
+// All the requests of a WindowInfo, which are sent as soon as it is constructed.
+struct WindowInfoCookies {
+  explicit WindowInfoCookies(Window window)
+      : class_hint_cookie(window, XA_WM_CLASS, XA_STRING, 1024),
+        net_wm_name_cookie(window, prop->net[atom::NET_WM_NAME], AnyPropertyType, 1024),
+        normal_hints_cookie(window, XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS, 1024),
+        window_type_cookie(window, prop->net[atom::NET_WM_WINDOW_TYPE], XA_ATOM, 1024),
+        state_cookie(window, prop->net[atom::NET_WM_STATE], XA_ATOM, 1024),
+        pid_cookie(window, prop->net[atom::NET_WM_PID], XA_CARDINAL, 1) {}
+
+  void Get(WindowInfo* info) {
+    pair<string, string> hint = ParseClassHint(class_hint_cookie);
+    info->res_class = std::move(hint.first);
+    info->res_name = std::move(hint.second);
+    // Anything after the first null byte is ignored, just like XGetTextProperty().
+    info->net_wm_name = net_wm_name_cookie.bytes().c_str();
+    info->normal_hints = ParseWmNormalHints(normal_hints_cookie);
+    info->window_types = window_type_cookie.values();
+    info->states = state_cookie.values();
+    info->pid = pid_cookie.values().empty() ? 0 : pid_cookie.values().front();
+    info->is_stale = false;
+  }
+
+  PropertyCookie class_hint_cookie;
+  PropertyCookie net_wm_name_cookie;
+  PropertyCookie normal_hints_cookie;
+  PropertyCookie window_type_cookie;
+  PropertyCookie state_cookie;
+  PropertyCookie pid_cookie;
+};
+
+// Returns the cache entry of `window`, which may be stale.
+WindowInfo* GetCachedWindowInfo(Window window) {
+  auto it = window_info_cache.find(window);
+
+  if (it == window_info_cache.end()) {
+    // Start listening to property changes before fetching them,
+    // so that we won't miss any change in between.
+    XSelectInput(dpy, window, PropertyChangeMask);
+    it = window_info_cache.emplace(window, WindowInfo()).first;
+  }
+  return &it->second;
+}
+
+bool Contains(const vector<unsigned long>& atoms, Atom target_atom) {
+  return target_atom && std::find(atoms.begin(), atoms.end(), target_atom) != atoms.end();
+}
+
+}  // namespace
+
+WindowInfo::WindowInfo()
+    : res_class(),
+      res_name(),
+      net_wm_name(),
+      window_types(),
+      states(),
+      normal_hints(),
+      pid(),
+      is_stale(true) {}
+
+bool WindowInfo::IsWindowOfType(Atom type_atom) const {
+  return Contains(window_types, type_atom);
+}
+
+bool WindowInfo::HasNetWmState(Atom state_atom) const {
+  return Contains(states, state_atom);
+}
+
+const WindowInfo& GetWindowInfo(Window window) {
+  WindowInfo* info = GetCachedWindowInfo(window);
+
+  if (info->is_stale) {
+    WindowInfoCookies(window).Get(info);
+  }
+  return *info;
+}
+
+void PrefetchWindowInfo(const vector<Window>& windows) {
+  vector<WindowInfo*> infos;
+  vector<WindowInfoCookies> cookies;
+  infos.reserve(windows.size());
+  cookies.reserve(windows.size());
+
+  // Send the requests of all the windows before waiting for any of the replies.
+  for (const auto window : windows) {
+    WindowInfo* info = GetCachedWindowInfo(window);
+    if (info->is_stale) {
+      infos.push_back(info);
+      cookies.emplace_back(window);
+    }
+  }
+
+  for (size_t i = 0; i < cookies.size(); i++) {
+    cookies[i].Get(infos[i]);
+  }
+}
+
+void OnPropertyNotify(const XPropertyEvent& e) {
+  auto it = window_info_cache.find(e.window);
+  if (it == window_info_cache.end()) {
+    return;
+  }
+
+  if (e.atom == XA_WM_CLASS || e.atom == XA_WM_NORMAL_HINTS ||
+      e.atom == prop->net[atom::NET_WM_NAME] || e.atom == prop->net[atom::NET_WM_PID] ||
+      e.atom == prop->net[atom::NET_WM_WINDOW_TYPE] ||
+      e.atom == prop->net[atom::NET_WM_STATE]) {
+    it->second.is_stale = true;
+  }
+}
+
+void ForgetWindowInfo(Window window) {
+  window_info_cache.erase(window);
+}
+
+
+// WM_CLASS contains two consecutive null-terminated strings: res_name and
+// res_class. Returns {res_class, res_name}.
+pair<string, string> ParseClassHint(PropertyCookie& cookie) {
+  if (!cookie.Get()) {
+    return std::make_pair("", "");
+  }
+
+  static const string undefined = "undefined";
+  const string& data = cookie.bytes();
+  size_t delim_pos = data.find('\0');
+
+  string res_name = data.substr(0, delim_pos);
+  string res_class;
+  if (delim_pos != string::npos) {
+    res_class = data.substr(delim_pos + 1);
+    res_class = res_class.substr(0, res_class.find('\0'));
+  }
+
+  return std::make_pair(res_class.empty() ? undefined : res_class,
+                        res_name.empty() ? undefined : res_name);
+}
+
+XSizeHints ParseWmNormalHints(PropertyCookie& cookie) {
+  XSizeHints hints;
+  std::memset(&hints, 0, sizeof(hints));
+
+  const vector<unsigned long>& data = cookie.values();
+  if (!cookie.Get() || data.size() < kOldNumPropSizeElements) {
+    return hints;
+  }
+
+  hints.flags = data[0];
+  hints.x = data[1];
+  hints.y = data[2];
+  hints.width = data[3];
+  hints.height = data[4];
+  hints.min_width = data[5];
+  hints.min_height = data[6];
+  hints.max_width = data[7];
+  hints.max_height = data[8];
+  hints.width_inc = data[9];
+  hints.height_inc = data[10];
+  hints.min_aspect.x = data[11];
+  hints.min_aspect.y = data[12];
+  hints.max_aspect.x = data[13];
+  hints.max_aspect.y = data[14];
+
+  if (data.size() >= kNumPropSizeElements) {
+    hints.base_width = data[15];
+    hints.base_height = data[16];
+    hints.win_gravity = data[17];
+  } else {
+    hints.flags &= ~(PBaseSize | PWinGravity);
+  }
+  return hints;
+}
+
+bool HasAtom(PropertyCookie& cookie, Atom target_atom) {
+  for (const auto atom : cookie.values()) {
+    if (atom && atom == target_atom) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace query
+
+}  // namespace wmderland
@@ -0,0 +1,129 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+#ifndef WMDERLAND_QUERY_H_
+#define WMDERLAND_QUERY_H_
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <sys/types.h>
+}
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "config.h"
+#include "properties.h"
+
+#if XCB_FOUND
+extern "C" {
+#include <xcb/xcb.h>
+}
+#endif
+
+namespace wmderland {
+
+// Asynchronous window queries.
+//
+// A cookie sends its request(s) to the X server as soon as it is constructed
+// and returns immediately. The reply is collected (and waited for, only if it
+// hasn't arrived yet) the first time Get() is called. So issue all the cookies
+// you need first, then collect their replies, and N queries will cost a single
+// round trip instead of N.
+//
+// When wmderland is built without libX11-xcb, the cookies fall back to the
+// synchronous Xlib calls, which are performed in Get().
+namespace query {
+
+void Init(Display* dpy, Properties* prop);
+
+class WindowAttributesCookie {
+ public:
+  explicit WindowAttributesCookie(Window window);
+  WindowAttributesCookie(WindowAttributesCookie&& other);
+  WindowAttributesCookie(const WindowAttributesCookie&) = delete;
+  virtual ~WindowAttributesCookie();
+
+  const XWindowAttributes& Get();
+
+ private:
+  Window window_;
+  XWindowAttributes attr_;
+  bool collected_;
+#if XCB_FOUND
+  xcb_get_window_attributes_cookie_t attr_cookie_;
+  xcb_get_geometry_cookie_t geometry_cookie_;
+#endif
+};
+
+class PropertyCookie {
+ public:
+  // `long_length` is the maximum length of the data to be retrieved,
+  // specified in 32-bit multiples (same as XGetWindowProperty).
+  PropertyCookie(Window window, Atom property, Atom type, long long_length);
+  PropertyCookie(PropertyCookie&& other);
+  PropertyCookie(const PropertyCookie&) = delete;
+  virtual ~PropertyCookie();
+
+  // Returns false if the property doesn't exist or has a mismatched type.
+  bool Get();
+
+  // Format 8 properties (e.g., STRING, UTF8_STRING).
+  const std::string& bytes();
+  // Format 32 properties (e.g., ATOM, CARDINAL, WM_SIZE_HINTS).
+  const std::vector<unsigned long>& values();
+
+ private:
+  Window window_;
+  Atom property_;
+  Atom type_;
+  long long_length_;
+  bool collected_;
+  bool exists_;
+  std::string bytes_;
+  std::vector<unsigned long> values_;
+#if XCB_FOUND
+  xcb_get_property_cookie_t cookie_;
+#endif
+};
+
+// All the properties that the WM has to inspect when it decides how to
+// manage a window.
+struct WindowInfo {
+  WindowInfo();
+
+  bool IsWindowOfType(Atom type_atom) const;
+  bool HasNetWmState(Atom state_atom) const;
+
+  std::string res_class;    // WM_CLASS
+  std::string res_name;     // WM_CLASS
+  std::string net_wm_name;  // _NET_WM_NAME
+  std::vector<unsigned long> window_types;  // _NET_WM_WINDOW_TYPE
+  std::vector<unsigned long> states;        // _NET_WM_STATE
+  XSizeHints normal_hints;  // WM_NORMAL_HINTS
+  pid_t pid;                // _NET_WM_PID, or 0 if unknown
+  bool is_stale;
+};
+
+// The WindowInfo of a window is fetched in a single round trip the first time
+// it is looked up, and then cached. At that moment we also start selecting
+// PropertyChangeMask on the window, and whenever one of the above properties
+// changes, the record is marked stale and will be fetched again on the next
+// lookup. So anyone who changes the event mask of a window must keep
+// PropertyChangeMask in it.
+const WindowInfo& GetWindowInfo(Window window);
+// Fetches the WindowInfo of many windows (which aren't cached yet) in a single
+// round trip, so that the GetWindowInfo() calls that follow won't block.
+void PrefetchWindowInfo(const std::vector<Window>& windows);
+void OnPropertyNotify(const XPropertyEvent& e);
+void ForgetWindowInfo(Window window);
+
+// Helpers which parse the replies of some common properties.
+std::pair<std::string, std::string> ParseClassHint(PropertyCookie& cookie);
+XSizeHints ParseWmNormalHints(PropertyCookie& cookie);
+bool HasAtom(PropertyCookie& cookie, Atom target_atom);
+
+}  // namespace query
+
+}  // namespace wmderland
+
+#endif  // WMDERLAND_QUERY_H_
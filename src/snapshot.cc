@@ -2,168 +2,323 @@
 #include "snapshot.h"
 
 extern "C" {
+#include <X11/Xatom.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 }
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
 #include <fstream>
+#include <iterator>
 
 #include "client.h"
+#include "log.h"
 #include "util.h"
 #include "window_manager.h"
 
-using std::array;
-using std::endl;
 using std::ifstream;
-using std::ofstream;
 using std::string;
 
 namespace wmderland {
 
-const string Snapshot::kNone_ = "none";
-const string Snapshot::kBacktrack_ = "b";
-const char Snapshot::kLeafPrefix_ = 'w';
-const char Snapshot::kInternalPrefix_ = 'i';
-const char Snapshot::kDelimiter_ = ' ';
+const char Snapshot::kMagic_[4] = {'W', 'M', 'D', 'S'};
+const uint32_t Snapshot::kVersion_ = 3;
 
 Snapshot::Snapshot(const string& filename)
-    : filename_(sys_utils::ToAbsPath(filename)), failed_count_() {}
+    : filename_(sys_utils::ToAbsPath(filename)), failed_count_(), saved_at_() {}
 
 bool Snapshot::FileExists() const {
   return access(filename_.c_str(), F_OK) != -1;
 }
 
 void Snapshot::Load() {
-  WindowManager* wm = WindowManager::GetInstance();
-  ifstream fin(filename_);
+  ifstream fin(filename_, std::ios::binary);
+  const string file((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
 
-  // 1. Load failed count.
-  // If the same error occurs constantly, throw this exception
-  // to immediately halt the window manager.
-  fin >> failed_count_;
-  if (failed_count_ >= 3) {
-    throw SnapshotLoadError();
+  // A snapshot which isn't ours (e.g., one written by an older version) is
+  // discarded, and the WM simply starts over.
+  if (!Deserialize(file, /*is_handoff=*/false)) {
+    WM_LOG(ERROR, "Discarding invalid snapshot: " << filename_);
+    rename(filename_.c_str(), (filename_ + ".failed_to_load").c_str());
+    return;
   }
 
-  // 2. Client deserailization.
-  int client_count = 0;
-  fin >> client_count;
+  // Rename snapshot file so that we know we have successfully load it.
+  // If the file cannot be renamed and cannot be remove, then throw
+  // SnapshotLoadError and the WM will return EXIT_FAILURE.
+  if (rename(filename_.c_str(), (filename_ + ".old").c_str()) == -1 &&
+      remove(filename_.c_str())) {  // remove() returns non-zero on failure
+    throw SnapshotLoadError();
+  }
 
-  for (int i = 0; i < client_count; i++) {
-    Window window = None;
-    int workspace_id = 0;
-    bool is_mapped = false;
-    bool is_floating = false;
-    bool is_fullscreen = false;
-    bool has_unmap_req_from_wm = false;
+  WindowManager::GetInstance()->ArrangeWindows();
+}
 
-    fin >> window >> workspace_id >> is_mapped >> is_floating >> is_fullscreen >>
-        has_unmap_req_from_wm;
+void Snapshot::Save() {
+  sys_utils::WriteFileAtomically(filename_, Serialize(++failed_count_));
+}
 
-    // The ownership of these client objects will be claimed during
-    // client tree deserialization!!! See Tree::Deserialize() in tree.cc
-    Client* client = new Client(wm->dpy_, window, wm->workspaces_[workspace_id].get());
-    client->set_mapped(is_mapped);
-    client->set_floating(is_floating);
-    client->set_fullscreen(is_fullscreen);
-    client->set_has_unmap_req_from_wm(has_unmap_req_from_wm);
+// The memfd is created without MFD_CLOEXEC so that it is inherited by the new
+// process, and sealed so that nothing can modify it after it has been written.
+int Snapshot::SaveToMemfd() {
+  const int fd = memfd_create("wmderland-snapshot", MFD_ALLOW_SEALING);
+  if (fd == -1) {
+    WM_LOG_WITH_ERRNO("memfd_create() failed", errno);
+    return -1;
   }
 
-  // 3. Client Tree deserialization will call Client::mapper_[window],
-  // so we have to restore all clients before doing this. See step 1.
-  for (const auto& workspace : wm->workspaces_) {
-    string data;
-    fin >> data;
-    workspace->Deserialize(data);
+  // A restart is not a failure, so the failed count starts over.
+  const string file = Serialize(0);
+  if (!sys_utils::WriteAll(fd, file.data(), file.size()) ||
+      fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1 ||
+      lseek(fd, 0, SEEK_SET) == -1) {
+    WM_LOG_WITH_ERRNO("Failed to write the snapshot to memfd", errno);
+    close(fd);
+    return -1;
   }
+  return fd;
+}
 
-  // 4. Current workspace deserialization.
-  int current_workspace = 0;
-  fin >> current_workspace;
-  wm->GotoWorkspace(current_workspace);
-
-  // 5. Docks/Notifications deserialization.
-  string line;
+bool Snapshot::LoadFromFd(int fd) {
+  string file;
+  char buf[BUFSIZ];
+  ssize_t size;
 
-  std::getline(fin, line);
-  if (line != Snapshot::kNone_) {
-    for (const auto& token : string_utils::Split(line, ',')) {
-      wm->docks_.insert(static_cast<Window>(std::stoul(token)));
-    }
+  while ((size = read(fd, buf, sizeof(buf))) > 0) {
+    file.append(buf, size);
   }
+  close(fd);
 
-  std::getline(fin, line);
-  if (line != Snapshot::kNone_) {
-    for (const auto& token : string_utils::Split(line, ',')) {
-      wm->notifications_.insert(static_cast<Window>(std::stoul(token)));
-    }
+  if (size == -1 || !Deserialize(file, /*is_handoff=*/true)) {
+    WM_LOG(ERROR, "Discarding invalid snapshot handed over by the previous WM");
+    return false;
   }
 
-  // 5. Rename snapshot file so that we know we have successfully load it.
-  // If the file cannot be renamed and cannot be remove, then throw
-  // SnapshotLoadError and the WM will return EXIT_FAILURE.
-  if (rename(filename_.c_str(), (filename_ + ".old").c_str()) == -1 &&
-      remove(filename_.c_str())) {  // remove() returns non-zero on failure
-    throw SnapshotLoadError();
-  }
-
-  wm->ArrangeWindows();
+  WM_LOG(INFO, "adopted " << Client::mapper_.size() << " clients from the previous WM");
+  return true;
 }
 
-void Snapshot::Save() {
+string Snapshot::Serialize(uint32_t failed_count) const {
   WindowManager* wm = WindowManager::GetInstance();
-  ofstream fout(filename_);
+  SnapshotWriter writer;
 
-  // 1. Write failed count.
-  fout << ++failed_count_ << endl;
+  // 1. Write failed count and the time of this snapshot.
+  writer.Write<uint32_t>(failed_count);
+  writer.Write<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now().time_since_epoch())
+                             .count());
 
   // 2. Client::mapper_ serialization.
-  fout << Client::mapper_.size() << endl;
+  writer.Write<uint32_t>(Client::mapper_.size());
 
   for (const auto& win_client_pair : Client::mapper_) {
     Window window = win_client_pair.first;
     Client* client = win_client_pair.second;
 
-    fout << window << Snapshot::kDelimiter_ << client->workspace()->id()
-         << Snapshot::kDelimiter_ << client->is_mapped() << Snapshot::kDelimiter_
-         << client->is_floating() << Snapshot::kDelimiter_ << client->is_fullscreen()
-         << Snapshot::kDelimiter_ << client->has_unmap_req_from_wm() << endl;
+    writer.Write<uint64_t>(window);
+    writer.Write<uint32_t>(client->workspace()->id());
+    writer.Write<uint8_t>(GetClientFlags(client));
   }
 
   // 3. Client Tree serialization.
   for (const auto& workspace : wm->workspaces_) {
-    fout << workspace->Serialize() << endl;
+    workspace->Serialize(&writer);
   }
 
   // 4. Curernt Workspace serialization.
-  fout << wm->current_ << endl;
+  writer.Write<uint32_t>(wm->current_);
 
-  // 5. Docks/notifications serialization.
-  if (wm->docks_.empty()) {
-    fout << Snapshot::kNone_;
-  } else {
-    size_t i = 0;
-    for (const auto window : wm->docks_) {
-      fout << window;
-      fout << ((i < wm->docks_.size() - 1) ? "," : "");
-      i++;
+  // 5. Docks/notifications/hidden windows serialization.
+  for (const auto* windows : {&wm->docks_, &wm->notifications_, &wm->hidden_windows_}) {
+    writer.Write<uint32_t>(windows->size());
+    for (const auto window : *windows) {
+      writer.Write<uint64_t>(window);
     }
   }
-  fout << endl;
 
-  if (wm->notifications_.empty()) {
-    fout << Snapshot::kNone_;
+  // 6. Cookie serialization.
+  const string cookie = wm->cookie_.Serialize();
+  writer.Write<uint32_t>(cookie.size());
+  writer.WriteBytes(cookie.data(), cookie.size());
+
+  // 7. Prepend the header.
+  const string& payload = writer.data();
+  Snapshot::Header header;
+  std::memcpy(header.magic, kMagic_, sizeof(kMagic_));
+  header.version = kVersion_;
+  header.payload_size = payload.size();
+  header.checksum = GetChecksum(payload.data(), payload.size());
+
+  string file(reinterpret_cast<const char*>(&header), sizeof(header));
+  file += payload;
+  return file;
+}
+
+// Returns false if `file` isn't a valid snapshot, in which case nothing has
+// been restored. If `is_handoff` is true, the windows are left exactly where
+// the previous WM has put them.
+bool Snapshot::Deserialize(const string& file, bool is_handoff) {
+  WindowManager* wm = WindowManager::GetInstance();
+
+  // 1. Verify the whole file before restoring anything from it.
+  Snapshot::Header header;
+  const char* payload = file.data() + sizeof(header);
+
+  if (file.size() >= sizeof(header)) {
+    std::memcpy(&header, file.data(), sizeof(header));
+  }
+  if (file.size() < sizeof(header) || std::memcmp(header.magic, kMagic_, sizeof(kMagic_)) ||
+      header.version != kVersion_ || header.payload_size != file.size() - sizeof(header) ||
+      header.checksum != GetChecksum(payload, header.payload_size)) {
+    return false;
+  }
+
+  SnapshotReader reader(payload, header.payload_size);
+
+  // 2. Load failed count.
+  // If the same error occurs constantly, throw this exception
+  // to immediately halt the window manager.
+  failed_count_ = reader.Read<uint32_t>();
+  if (failed_count_ >= 3) {
+    throw SnapshotLoadError();
+  }
+  saved_at_ = reader.Read<uint64_t>();
+
+  // 3. Client deserailization.
+  const uint32_t client_count = reader.Read<uint32_t>();
+
+  for (uint32_t i = 0; i < client_count; i++) {
+    const Window window = reader.Read<uint64_t>();
+    const uint32_t workspace_id = reader.Read<uint32_t>();
+    const uint8_t flags = reader.Read<uint8_t>();
+
+    if (workspace_id >= wm->workspaces_.size()) {
+      throw SnapshotLoadError();
+    }
+
+    // The ownership of these client objects will be claimed during
+    // client tree deserialization!!! See Tree::Deserialize() in tree.cc
+    Client* client = new Client(wm->dpy_, window, wm->workspaces_[workspace_id].get());
+    RestoreClientFlags(client, flags);
+    wm->client_list_.push_back(window);
+  }
+  wm->is_client_list_dirty_ = true;
+
+  // 4. Client Tree deserialization will call Client::mapper_.Find(window),
+  // so we have to restore all clients before doing this. See step 3.
+  for (const auto& workspace : wm->workspaces_) {
+    workspace->Deserialize(&reader);
+  }
+
+  // 5. Current workspace deserialization. After a handoff, the windows of the
+  // other workspaces are already unmapped, so the workspace is only switched
+  // on our side.
+  const uint32_t current_workspace = reader.Read<uint32_t>();
+  if (current_workspace >= wm->workspaces_.size()) {
+    throw SnapshotLoadError();
+  }
+
+  if (!is_handoff) {
+    wm->GotoWorkspace(current_workspace);
   } else {
-    size_t i = 0;
-    for (const auto window : wm->notifications_) {
-      fout << window;
-      fout << ((i < wm->notifications_.size() - 1) ? "," : "");
-      i++;
+    long current = current_workspace;
+    wm->current_ = current_workspace;
+    XChangeProperty(wm->dpy_, wm->root_window_, wm->prop_->net[atom::NET_CURRENT_DESKTOP],
+                    XA_CARDINAL, 32, PropModeReplace, reinterpret_cast<unsigned char*>(&current),
+                    1);
+
+    // Client's constructor has reset the border color of the focused client.
+    Workspace* workspace = wm->workspaces_[current_workspace].get();
+    if (Client* focused_client = workspace->GetFocusedClient()) {
+      focused_client->SetBorderColor(workspace->config()->focused_color());
+    }
+  }
+
+  // 6. Docks/Notifications/hidden windows deserialization.
+  for (auto* windows : {&wm->docks_, &wm->notifications_, &wm->hidden_windows_}) {
+    for (uint32_t i = 0, window_count = reader.Read<uint32_t>(); i < window_count; i++) {
+      windows->insert(static_cast<Window>(reader.Read<uint64_t>()));
     }
   }
-  fout << endl;
+
+  // 7. Cookie deserialization.
+  const uint32_t cookie_size = reader.Read<uint32_t>();
+  wm->cookie_.Deserialize(string(reader.ReadBytes(cookie_size), cookie_size));
+
+  if (!reader.eof()) {
+    throw SnapshotLoadError();
+  }
+  return true;
 }
 
 const string& Snapshot::filename() const {
   return filename_;
 }
 
+uint64_t Snapshot::saved_at() const {
+  return saved_at_;
+}
+
+uint8_t Snapshot::GetClientFlags(const Client* client) {
+  return client->is_mapped() << 0 | client->is_floating() << 1 | client->is_fullscreen() << 2 |
+      client->has_unmap_req_from_wm() << 3;
+}
+
+void Snapshot::RestoreClientFlags(Client* client, uint8_t flags) {
+  client->set_mapped(flags & (1 << 0));
+  client->set_floating(flags & (1 << 1));
+  client->set_fullscreen(flags & (1 << 2));
+  client->set_has_unmap_req_from_wm(flags & (1 << 3));
+
+  // The events selected by the previous WM went away with its connection, and
+  // a window which is still mapped won't generate another MapNotify.
+  client->SelectInput(client->is_mapped() ? EnterWindowMask | PropertyChangeMask
+                                          : PropertyChangeMask);
+}
+
+// 64-bit FNV-1a.
+uint64_t Snapshot::GetChecksum(const char* data, size_t size) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+
+SnapshotWriter::SnapshotWriter() : data_() {}
+
+void SnapshotWriter::WriteBytes(const char* data, size_t size) {
+  data_.append(data, size);
+}
+
+void SnapshotWriter::Clear() {
+  data_.clear();
+}
+
+const string& SnapshotWriter::data() const {
+  return data_;
+}
+
+
+SnapshotReader::SnapshotReader(const char* data, size_t size)
+    : data_(data), size_(size), offset_() {}
+
+const char* SnapshotReader::ReadBytes(size_t size) {
+  if (size > size_ - offset_) {
+    throw Snapshot::SnapshotLoadError();
+  }
+
+  const char* bytes = data_ + offset_;
+  offset_ += size;
+  return bytes;
+}
+
+bool SnapshotReader::eof() const {
+  return offset_ == size_;
+}
+
 }  // namespace wmderland
@@ -6,6 +6,8 @@ extern "C" {
 #include <X11/Xlib.h>
 }
 #include <array>
+#include <cstdint>
+#include <cstring>
 #include <exception>
 #include <string>
 
@@ -14,6 +16,14 @@ extern "C" {
 
 namespace wmderland {
 
+// A snapshot is a binary file in the native byte order, which starts with a
+// header (magic, version, payload size and checksum) followed by the payload.
+// It is written atomically, and the whole file is verified before anything
+// is restored from it.
+//
+// The same image is used to restart the WM in place: it is written to a sealed
+// memfd which survives execve(), and the new process adopts every window from
+// it without mapping or arranging anything (see LoadFromFd()).
 class Snapshot {
  public:
   class SnapshotLoadError : public std::exception {
@@ -31,18 +41,89 @@ class Snapshot {
   void Load();
   void Save();
 
+  int SaveToMemfd();  // returns the sealed memfd, or -1 on failure
+  bool LoadFromFd(int fd);
+
   const std::string& filename() const;
+  uint64_t saved_at() const;  // steady clock time in ns, or 0 if nothing has been loaded
 
-  static const std::string kNone_;
-  static const std::string kBacktrack_;
-  static const char kLeafPrefix_;
-  static const char kInternalPrefix_;
+  // A client's mapped, floating, fullscreen and has_unmap_req_from_wm bits.
+  // Restoring them also selects the events the WM needs on a client in that
+  // state, since a restored client hasn't gone through OnMapNotify().
+  static uint8_t GetClientFlags(const Client* client);
+  static void RestoreClientFlags(Client* client, uint8_t flags);
+  static uint64_t GetChecksum(const char* data, size_t size);
 
  private:
-  static const char kDelimiter_;
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t payload_size;
+    uint64_t checksum;
+  };
+
+  static const char kMagic_[4];
+  static const uint32_t kVersion_;
+
+  std::string Serialize(uint32_t failed_count) const;
+  bool Deserialize(const std::string& file, bool is_handoff);
 
   const std::string filename_;
   int failed_count_;
+  uint64_t saved_at_;
+};
+
+// Appends fixed-size values to a snapshot payload.
+class SnapshotWriter {
+ public:
+  SnapshotWriter();
+  virtual ~SnapshotWriter() = default;
+
+  template <typename T>
+  void Write(T value) {
+    data_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  // Overwrites a value written before, e.g., a count which wasn't known yet.
+  template <typename T>
+  void Overwrite(size_t offset, T value) {
+    data_.replace(offset, sizeof(value), reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  void WriteBytes(const char* data, size_t size);
+  void Clear();
+  const std::string& data() const;
+
+ private:
+  std::string data_;
+};
+
+// Reads the values back in the same order, straight out of the buffer. Reading
+// past the end throws Snapshot::SnapshotLoadError.
+class SnapshotReader {
+ public:
+  SnapshotReader(const char* data, size_t size);
+  virtual ~SnapshotReader() = default;
+
+  template <typename T>
+  T Read() {
+    if (sizeof(T) > size_ - offset_) {
+      throw Snapshot::SnapshotLoadError();
+    }
+
+    T value;
+    std::memcpy(&value, data_ + offset_, sizeof(value));
+    offset_ += sizeof(value);
+    return value;
+  }
+
+  const char* ReadBytes(size_t size);  // returns a pointer into the buffer
+  bool eof() const;
+
+ private:
+  const char* data_;
+  size_t size_;
+  size_t offset_;
 };
 
 }  // namespace wmderland
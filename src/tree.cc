@@ -2,53 +2,94 @@
 #include "tree.h"
 
 #include <algorithm>
-#include <queue>
-#include <stack>
 
 #include "client.h"
 #include "snapshot.h"
 #include "util.h"
 
-using std::queue;
-using std::stack;
-using std::string;
 using std::unique_ptr;
-using std::unordered_map;
 using std::vector;
 
 namespace wmderland {
 
 const double Tree::Node::min_ratio_ = 0.01;
+const uint32_t Tree::kNullIndex_ = static_cast<uint32_t>(-1);
 
-unordered_map<Client*, Tree::Node*> Tree::Node::mapper_;
-
-Tree::Tree() : root_node_(std::make_unique<Tree::Node>(nullptr)), current_node_() {
+Tree::Tree()
+    : chunks_(), free_indices_(), allocated_count_(), root_(), current_node_() {
   // NOTE: In wmderland, the root node will always exist in a client tree
   // at any given time.
 
   // Initialize a Tree::Node with no client associated with it,
   // and set its tiling direction to HORIZONTAL by default.
-  root_node_->set_tiling_direction(TilingDirection::HORIZONTAL);
+  Tree::Node* root_node = NewNode().release();
+  root_node->set_tiling_direction(TilingDirection::HORIZONTAL);
+  root_ = root_node->index_;
 }
 
-Tree::Node* Tree::GetTreeNode(Client* client) const {
-  auto it = Tree::Node::mapper_.find(client);
-  if (it == Tree::Node::mapper_.end()) {
-    return nullptr;
+Tree::NodePtr Tree::NewNode(unique_ptr<Client> client) {
+  uint32_t index = 0;
+
+  if (!free_indices_.empty()) {
+    index = free_indices_.back();
+    free_indices_.pop_back();
+  } else {
+    if (allocated_count_ == chunks_.size() * kChunkSize_) {
+      chunks_.push_back(std::make_unique<Tree::Node[]>(kChunkSize_));
+    }
+    index = allocated_count_++;
+  }
+
+  Tree::Node* node = GetNode(index);
+  node->tree_ = this;
+  node->index_ = index;
+  node->parent_ = kNullIndex_;
+  node->position_ = 0;
+  node->child_count_ = 0;
+  node->overflow_children_.clear();
+  node->tiling_direction_ = TilingDirection::UNSPECIFIED;
+  node->ratio_ = 0.;
+  node->tiling_leaf_count_ = 0;
+  node->floating_leaf_count_ = 0;
+  node->prev_leaf_ = kNullIndex_;
+  node->next_leaf_ = kNullIndex_;
+  node->set_client(std::move(client));
+  return Tree::NodePtr(node);
+}
+
+void Tree::FreeNode(Tree::Node* node) {
+  for (const auto child : node->children()) {
+    FreeNode(child);
   }
-  return it->second;
+
+  node->child_count_ = 0;
+  node->parent_ = kNullIndex_;
+  node->set_client(nullptr);
+  node->tiling_leaf_count_ = 0;
+  node->floating_leaf_count_ = 0;
+  node->prev_leaf_ = kNullIndex_;
+  node->next_leaf_ = kNullIndex_;
+  free_indices_.push_back(node->index_);
+}
+
+Tree::Node* Tree::GetNode(uint32_t index) const {
+  return &chunks_[index >> kChunkShift_][index & (kChunkSize_ - 1)];
 }
 
-vector<Tree::Node*> Tree::GetLeaves() const {
-  return root_node_->GetLeaves();
+Tree::Node* Tree::GetNodeOrNull(uint32_t index) const {
+  return (index == kNullIndex_) ? nullptr : GetNode(index);
+}
+
+Tree::Node* Tree::GetTreeNode(Client* client) const {
+  return client->node();
 }
 
 void Tree::Normalize() {
-  root_node_->Normalize();
+  root_node()->Normalize();
 }
 
 Tree::Node* Tree::root_node() const {
-  return root_node_.get();
+  return GetNode(root_);
 }
 
 Tree::Node* Tree::current_node() const {
@@ -59,209 +100,188 @@ void Tree::set_current_node(Tree::Node* node) {
   current_node_ = node;
 }
 
-void Tree::Deserialize(string data) {
-  // Extract current window id at the beginning (before '|'),
-  // and then erase it including the '|' character.
-  size_t delim_pos = data.find('|');
-  string current_window = data.substr(0, delim_pos);
-  data.erase(0, delim_pos + 1);
-
-  // Split nodes into a queue.
-  // A token can be a leaf or an internal node.
-  queue<string> val_queue;
-  for (const auto& token : string_utils::Split(data, ',')) {
-    val_queue.push(token);
-  }
-
-  // Construct root_node_.
-  string root_val = val_queue.front();
-  val_queue.pop();
-  root_val.erase(0, 1);
-  root_node_->set_tiling_direction(static_cast<TilingDirection>(std::stoi(root_val)));
-
-  // Push the root node onto the stack and perform iterative DFS.
-  stack<Tree::Node*> st;
-  st.push(root_node_.get());
-  current_node_ = st.top();
-
-  while (!val_queue.empty()) {
-    string val = val_queue.front();
-    val_queue.pop();
-
-    // Backtrack
-    if (val == Snapshot::kBacktrack_) {
-      st.pop();
-      current_node_ = st.top();
-      continue;
-    }
-
-    // Deserialize
-    unique_ptr<Tree::Node> new_node = std::make_unique<Tree::Node>(nullptr);
-    if (val.front() == Snapshot::kLeafPrefix_) {
-      val.erase(0, 1);
-      unique_ptr<Client> client(Client::mapper_[static_cast<Window>(std::stoul(val))]);
-      new_node->set_client(std::move(client));
-    } else {  // val.front() == Snapshot::kInternalPrefix_
-      val.erase(0, 1);
-      new_node->set_tiling_direction(static_cast<TilingDirection>(std::stoi(val)));
-    }
+void Tree::Deserialize(SnapshotReader* reader) {
+  const Window current_window = reader->Read<uint64_t>();
 
-    current_node_->AddChild(std::move(new_node));
-    current_node_->children().back();
-    st.push(new_node.get());
-  }
+  // The root node always exists, so it is restored in place.
+  DfsDeserializeHelper(root_node(), reader);
 
   // Restore current_node_.
-  if (current_window == Snapshot::kNone_) {
+  if (current_window == None) {
     current_node_ = nullptr;
   } else {
-    Window window = static_cast<Window>(std::stoul(current_window));
-    Client* client = Client::mapper_.at(window);
-    current_node_ = Tree::Node::mapper_.at(client);
+    Client* client = Client::mapper_.Find(current_window);
+    if (!client || !client->node()) {
+      throw Snapshot::SnapshotLoadError();
+    }
+    current_node_ = client->node();
   }
 }
 
-string Tree::Serialize() const {
-  string data;
-
+void Tree::Serialize(SnapshotWriter* writer) const {
   // The current_node_ is serialized and stored at the beginning of data.
-  if (current_node_) {
-    data += std::to_string(current_node_->client()->window());
-  } else {
-    data += Snapshot::kNone_;
-  }
-  data += '|';
+  writer->Write<uint64_t>(current_node_ ? current_node_->client()->window() : None);
 
   // Serialize the entire tree.
-  if (root_node_->leaf()) {
-    return data + Snapshot::kInternalPrefix_ +
-        std::to_string(static_cast<int>(root_node_->tiling_direction()));
-  } else {
-    DfsSerializeHelper(root_node_.get(), data);
-    // There will be extra ',' + "b,"
-    return data.erase(data.rfind("," + Snapshot::kBacktrack_ + ","));
-  }
+  DfsSerializeHelper(root_node(), writer);
 }
 
-void Tree::DfsSerializeHelper(Tree::Node* node, string& data) const {
-  if (!node) {
-    return;
-  }
+// Each node is serialized as its tiling direction, the window of its client
+// (None for internal nodes) and its number of children, followed by its
+// children in order and then their ratios. The ratios come last since adding
+// a child changes the ratios of its siblings.
+void Tree::DfsSerializeHelper(Tree::Node* node, SnapshotWriter* writer) const {
+  writer->Write<uint8_t>(static_cast<uint8_t>(node->tiling_direction()));
+  writer->Write<uint64_t>(node->client() ? node->client()->window() : None);
+  writer->Write<uint32_t>(node->children().size());
 
-  // Serialize current node, format:
-  // 1. If node is a leaf: w<Window>
-  // 2. If node is internal: i<TilingDirection>
-  //
-  // Exception: when there are no windows at all, the root node will become a
-  // leaf, but we don't want this to happen! (It will segfault)
-  //
-  // Solution: when the root node is a leaf, we don't have to serialize
-  // anything.
-  if (node->leaf()) {
-    data += Snapshot::kLeafPrefix_ + std::to_string(node->client()->window());
-  } else {
-    data += Snapshot::kInternalPrefix_ +
-        std::to_string(static_cast<int>(node->tiling_direction()));
+  for (const auto child : node->children()) {
+    DfsSerializeHelper(child, writer);
   }
-  data += ',';
-
   for (const auto child : node->children()) {
-    DfsSerializeHelper(child, data);
+    writer->Write<double>(child->ratio_);
   }
-
-  // Add 'b' which indicates when to backtrack
-  // during deserialization.
-  data += Snapshot::kBacktrack_ + ',';
 }
 
-Tree::Node::Node(unique_ptr<Client> client)
-    : parent_(), client_(std::move(client)), tiling_direction_(TilingDirection::UNSPECIFIED) {
-  if (client_) {
-    Tree::Node::mapper_[client_.get()] = this;
+void Tree::DfsDeserializeHelper(Tree::Node* node, SnapshotReader* reader) {
+  node->set_tiling_direction(static_cast<TilingDirection>(reader->Read<uint8_t>()));
+
+  const Window window = reader->Read<uint64_t>();
+  if (window != None) {
+    Client* client = Client::mapper_.Find(window);
+    if (!client || client->node()) {
+      throw Snapshot::SnapshotLoadError();
+    }
+    node->set_client(unique_ptr<Client>(client));
   }
-}
 
-Tree::Node::~Node() {
-  Tree::Node::mapper_.erase(client_.get());
+  const uint32_t child_count = reader->Read<uint32_t>();
+  for (uint32_t i = 0; i < child_count; i++) {
+    Tree::NodePtr child = NewNode();
+    Tree::Node* child_raw = child.get();
+    node->AddChild(std::move(child));
+    DfsDeserializeHelper(child_raw, reader);
+  }
+  for (const auto child : node->children()) {
+    child->ratio_ = reader->Read<double>();
+  }
 }
 
-void Tree::Node::AddChild(unique_ptr<Tree::Node> child) {
-  Tree::Node* child_raw = child.get();
-  child->set_parent(this);
-  children_.push_back(std::move(child));
+Tree::Node::Node()
+    : tree_(),
+      index_(),
+      parent_(Tree::kNullIndex_),
+      position_(),
+      child_count_(),
+      inline_children_(),
+      overflow_children_(),
+      client_(),
+      tiling_direction_(TilingDirection::UNSPECIFIED),
+      ratio_(),
+      tiling_leaf_count_(),
+      floating_leaf_count_(),
+      prev_leaf_(Tree::kNullIndex_),
+      next_leaf_(Tree::kNullIndex_) {}
+
+void Tree::Node::AddChild(Tree::NodePtr child) {
+  Tree::Node* child_raw = child.release();
+  AttachChild(child_count_, child_raw);
 
   FitChildrenRatiosAfterInsertion(child_raw);
 }
 
-unique_ptr<Tree::Node> Tree::Node::RemoveChild(Tree::Node* child) {
-  unique_ptr<Tree::Node> removed_ptr = nullptr;
+Tree::NodePtr Tree::Node::RemoveChild(Tree::Node* child) {
+  size_t position = GetChildPosition(child);
+  if (position == child_count_) {
+    return nullptr;
+  }
 
-  child->set_parent(nullptr);
-  children_.erase(std::remove_if(children_.begin(), children_.end(),
-                                 [&](unique_ptr<Tree::Node>& node) {
-                                   return node.get() == child &&
-                                       (removed_ptr = std::move(node), true);
-                                 }),
-                  children_.end());
+  DetachChild(position);
 
   FitChildrenRatios();
 
-  return removed_ptr;
+  return Tree::NodePtr(child);
 }
 
-void Tree::Node::InsertChildAfter(unique_ptr<Tree::Node> child, Tree::Node* ref) {
+void Tree::Node::InsertChildAfter(Tree::NodePtr child, Tree::Node* ref) {
   InsertChildBeside(std::move(child), ref, TilingPosition::AFTER);
 }
 
-void Tree::Node::InsertChildBeside(unique_ptr<Tree::Node> child, Tree::Node* ref,
+void Tree::Node::InsertChildBeside(Tree::NodePtr child, Tree::Node* ref,
                                    TilingPosition tiling_position) {
-  Tree::Node* child_raw = child.get();
+  Tree::Node* child_raw = child.release();
 
-  child->set_parent(this);
-  ptrdiff_t ref_idx =
-      std::find_if(children_.begin(), children_.end(),
-                   [&](unique_ptr<Tree::Node>& node) { return node.get() == ref; }) -
-      children_.begin();
-  ptrdiff_t position = tiling_position == TilingPosition::BEFORE ? 0 : 1;
-  children_.insert(children_.begin() + ref_idx + position, std::move(child));
+  size_t ref_idx = GetChildPosition(ref);
+  size_t position = tiling_position == TilingPosition::BEFORE ? 0 : 1;
+  AttachChild(ref_idx + position, child_raw);
 
   FitChildrenRatiosAfterInsertion(child_raw);
 }
 
 // Insert a child node, but every current child of this node will be the child of the inserted
 // node.
-void Tree::Node::InsertChildAboveChildren(unique_ptr<Tree::Node> child) {
-  for (const auto current_child : children()) {
-    unique_ptr<Tree::Node> current_child_ptr = RemoveChild(current_child);
-    child->AddChild(std::move(current_child_ptr));
+void Tree::Node::InsertChildAboveChildren(Tree::NodePtr child) {
+  while (child_count_ > 0) {
+    child->AddChild(RemoveChild(children().front()));
   }
 
   AddChild(std::move(child));
 }
 
 // Insert a node as a parent while lifting the current parent up to the grandparent.
-void Tree::Node::InsertParent(std::unique_ptr<Tree::Node> parent) {
+void Tree::Node::InsertParent(Tree::NodePtr parent) {
   Tree::Node* parent_raw = parent.get();
+  Tree::Node* grandparent = this->parent();
 
-  parent_->InsertChildAfter(std::move(parent), this);
-  unique_ptr<Tree::Node> this_ptr = parent_->RemoveChild(this);
-  parent_raw->AddChild(std::move(this_ptr));
+  grandparent->InsertChildAfter(std::move(parent), this);
+  parent_raw->AddChild(grandparent->RemoveChild(this));
 }
 
 void Tree::Node::Swap(Tree::Node* destination) {
-  if (!leaf() || !destination->leaf() || !parent_ || !destination->parent_) {
+  if (!leaf() || !destination->leaf() || !parent() || !destination->parent()) {
     return;
   }
 
-  unique_ptr<Tree::Node>& this_ptr = owning_pointer();
-  unique_ptr<Tree::Node>& dest_ptr = destination->owning_pointer();
+  Tree::Node* this_parent = parent();
+  Tree::Node* dest_parent = destination->parent();
+
+  // Both leaves are moved out of their subtrees and then into each other's.
+  this_parent->AddToLeafCounts(-tiling_leaf_count_, -floating_leaf_count_);
+  dest_parent->AddToLeafCounts(-destination->tiling_leaf_count_,
+                               -destination->floating_leaf_count_);
 
-  this_ptr.swap(dest_ptr);
+  std::swap(this_parent->child_indices()[position_],
+            dest_parent->child_indices()[destination->position_]);
   std::swap(parent_, destination->parent_);
+  std::swap(position_, destination->position_);
+
+  Tree::Node* this_prev = prev_leaf();
+  Tree::Node* this_next = next_leaf();
+  Tree::Node* dest_prev = destination->prev_leaf();
+  Tree::Node* dest_next = destination->next_leaf();
+
+  if (this_next == destination) {
+    LinkLeaves(this_prev, destination);
+    LinkLeaves(destination, this);
+    LinkLeaves(this, dest_next);
+  } else if (dest_next == this) {
+    LinkLeaves(dest_prev, this);
+    LinkLeaves(this, destination);
+    LinkLeaves(destination, this_next);
+  } else {
+    LinkLeaves(this_prev, destination);
+    LinkLeaves(destination, this_next);
+    LinkLeaves(dest_prev, this);
+    LinkLeaves(this, dest_next);
+  }
+
+  dest_parent->AddToLeafCounts(tiling_leaf_count_, floating_leaf_count_);
+  this_parent->AddToLeafCounts(destination->tiling_leaf_count_,
+                               destination->floating_leaf_count_);
 }
 
 void Tree::Node::Resize(double delta) {
-  if (!parent_) {
+  if (!parent()) {
     return;
   }
 
@@ -276,16 +296,16 @@ void Tree::Node::Resize(double delta) {
   this->ratio_ += delta;
   sibling->ratio_ -= delta;
 
-  parent_->FitChildrenRatios();
+  parent()->FitChildrenRatios();
 }
 
 // Resize this node to specific ratio and distribute the remaining space to siblings evenly.
 void Tree::Node::ResizeToRatio(double ratio) {
-  if (!parent_ || ratio >= 1.) {
+  if (!parent() || ratio >= 1.) {
     return;
   }
 
-  size_t num_siblings = parent_->children_.size() - 1;
+  size_t num_siblings = parent()->child_count_ - 1;
   double min_siblings_ratio = min_ratio_ * num_siblings;
   if (ratio + min_siblings_ratio > 1.) {
     ratio = 1. - min_siblings_ratio;
@@ -296,24 +316,24 @@ void Tree::Node::ResizeToRatio(double ratio) {
 
   ratio_ = ratio;
   double sibling_ratio = (1. - ratio) / num_siblings;
-  for (auto& child : parent_->children()) {
+  for (const auto child : parent()->children()) {
     if (child != this) child->ratio_ = sibling_ratio;
   }
 
-  parent_->FitChildrenRatios();
+  parent()->FitChildrenRatios();
 }
 
 // Resize the children to distribute this node's length to children evenly.
 void Tree::Node::DistributeChildrenRatios() {
-  for (auto& child : children()) {
-    child->ratio_ = 1. / children_.size();
+  for (const auto child : children()) {
+    child->ratio_ = 1. / child_count_;
   }
 }
 
 // Normalize the children's ratios so that the sum of them equals to 1.0.
 void Tree::Node::FitChildrenRatios() {
   double total_ratio = 0.;
-  for (const auto& child : children()) {
+  for (const auto child : children()) {
     total_ratio += child->ratio_;
   }
 
@@ -321,14 +341,14 @@ void Tree::Node::FitChildrenRatios() {
     return;
   }
 
-  for (auto& child : children()) {
+  for (const auto child : children()) {
     child->ratio_ /= total_ratio;
   }
 }
 
 // Determine the ratio for new node and then do the ratio normalization.
 void Tree::Node::FitChildrenRatiosAfterInsertion(Tree::Node* inserted) {
-  size_t n = children_.size() - 1;
+  size_t n = child_count_ - 1;
   inserted->ratio_ = n == 0 ? 1. : 1. / n;
 
   FitChildrenRatios();
@@ -336,9 +356,13 @@ void Tree::Node::FitChildrenRatiosAfterInsertion(Tree::Node* inserted) {
 
 // Delete redundant internal nodes below this node.
 void Tree::Node::Normalize() {
-  for (auto& child : children()) {
-    if (child->children_.size() == 1) {
-      unique_ptr<Tree::Node> grandchild = child->RemoveChild(child->children_.front().get());
+  // A redundant child is replaced by its only child in place, so the children
+  // are visited by position rather than through a Children view.
+  for (size_t i = 0; i < child_count_; i++) {
+    Tree::Node* child = children()[i];
+
+    if (child->child_count_ == 1) {
+      Tree::NodePtr grandchild = child->RemoveChild(child->children().front());
       Tree::Node* grandchild_raw = grandchild.get();
 
       InsertChildAfter(std::move(grandchild), child);
@@ -352,76 +376,74 @@ void Tree::Node::Normalize() {
 }
 
 Tree::Node* Tree::Node::GetLeftSibling() const {
-  vector<Tree::Node*> siblings = parent_->children();
+  return (position_ == 0) ? nullptr : parent()->children()[position_ - 1];
+}
 
-  if (this == siblings.front()) {
+Tree::Node* Tree::Node::GetRightSibling() const {
+  if (position_ + 1 == parent()->child_count_) {
     return nullptr;
-  } else {
-    ptrdiff_t this_node_idx =
-        std::find(siblings.begin(), siblings.end(), this) - siblings.begin();
-    return siblings[this_node_idx - 1];
   }
+  return parent()->children()[position_ + 1];
 }
 
-Tree::Node* Tree::Node::GetRightSibling() const {
-  vector<Tree::Node*> siblings = parent_->children();
+Tree::Node* Tree::Node::GetFirstLeaf() {
+  Tree::Node* node = this;
+  while (!node->leaf()) {
+    node = node->children().front();
+  }
+  return node;
+}
 
-  if (this == siblings.back()) {
-    return nullptr;
-  } else {
-    ptrdiff_t this_node_idx =
-        std::find(siblings.begin(), siblings.end(), this) - siblings.begin();
-    return siblings[this_node_idx + 1];
+Tree::Node* Tree::Node::GetLastLeaf() {
+  Tree::Node* node = this;
+  while (!node->leaf()) {
+    node = node->children().back();
   }
+  return node;
 }
 
-vector<Tree::Node*> Tree::Node::GetLeaves() {
-  vector<Tree::Node*> leaves;
-  stack<Tree::Node*> st;
-  st.push(this);
+bool Tree::Node::HasTilingClientsInSubtree() const {
+  return tiling_leaf_count_ > 0;
+}
 
-  while (!st.empty()) {
-    Tree::Node* node = st.top();
-    st.pop();
+// Recount this leaf after its client has been set, released, floated or tiled,
+// and propagate the difference to its ancestors.
+void Tree::Node::UpdateLeafCounts() {
+  if (!leaf()) {
+    return;
+  }
 
-    // If this node is a leaf, add it to the leaf vector.
-    if (node->children().empty()) {
-      leaves.push_back(node);
-    }
+  int tiling_leaf_count = (client_ && !client_->is_floating()) ? 1 : 0;
+  int floating_leaf_count = (client_ && client_->is_floating()) ? 1 : 0;
+  AddToLeafCounts(tiling_leaf_count - tiling_leaf_count_,
+                  floating_leaf_count - floating_leaf_count_);
+}
 
-    // Push all children onto the stack in reverse order (if any).
-    for (int i = node->children().size() - 1; i >= 0; i--) {
-      st.push(node->children().at(i));
-    }
+void Tree::Node::AddToLeafCounts(int tiling_delta, int floating_delta) {
+  if (tiling_delta == 0 && floating_delta == 0) {
+    return;
   }
-  return leaves;
-}
 
-bool Tree::Node::HasTilingClientsInSubtree() {
-  // Get all leaves from this node's subtree,
-  // and check if it has any tiling client.
-  for (auto leaf : this->GetLeaves()) {
-    if (!leaf->client()->is_floating()) {
-      return true;
-    }
+  for (Tree::Node* node = this; node; node = node->parent()) {
+    node->tiling_leaf_count_ += tiling_delta;
+    node->floating_leaf_count_ += floating_delta;
   }
-  return false;
 }
 
-vector<Tree::Node*> Tree::Node::children() const {
-  vector<Tree::Node*> children(children_.size());
-  for (size_t i = 0; i < children.size(); i++) {
-    children[i] = children_[i].get();
-  }
-  return children;
+Tree::Children Tree::Node::children() const {
+  return Tree::Children(tree_, child_indices(), child_count_);
 }
 
 Tree::Node* Tree::Node::parent() const {
-  return parent_;
+  return tree_->GetNodeOrNull(parent_);
 }
 
-void Tree::Node::set_parent(Tree::Node* parent) {
-  parent_ = parent;
+Tree::Node* Tree::Node::prev_leaf() const {
+  return tree_->GetNodeOrNull(prev_leaf_);
+}
+
+Tree::Node* Tree::Node::next_leaf() const {
+  return tree_->GetNodeOrNull(next_leaf_);
 }
 
 // Get the client associated with this node.
@@ -430,15 +452,23 @@ Client* Tree::Node::client() const {
 }
 
 void Tree::Node::set_client(unique_ptr<Client> client) {
-  Tree::Node::mapper_.erase(client_.get());
+  if (client_) {
+    client_->set_node(nullptr);
+  }
   if (client) {
-    Tree::Node::mapper_[client.get()] = this;
+    client->set_node(this);
   }
   client_ = std::move(client);
+  UpdateLeafCounts();
 }
 
 Client* Tree::Node::release_client() {
-  return client_.release();
+  if (client_) {
+    client_->set_node(nullptr);
+  }
+  Client* client = client_.release();
+  UpdateLeafCounts();
+  return client;
 }
 
 TilingDirection Tree::Node::tiling_direction() const {
@@ -449,17 +479,196 @@ void Tree::Node::set_tiling_direction(TilingDirection tiling_direction) {
   tiling_direction_ = tiling_direction;
 }
 
+void Tree::Node::set_ratio(double ratio) {
+  ratio_ = ratio;
+}
+
 double Tree::Node::ratio() const {
   return ratio_;
 }
 
 bool Tree::Node::leaf() const {
-  return children_.empty();
+  return child_count_ == 0;
+}
+
+int Tree::Node::tiling_leaf_count() const {
+  return tiling_leaf_count_;
+}
+
+int Tree::Node::floating_leaf_count() const {
+  return floating_leaf_count_;
+}
+
+int Tree::Node::leaf_count() const {
+  return tiling_leaf_count_ + floating_leaf_count_;
+}
+
+uint32_t* Tree::Node::child_indices() {
+  return (child_count_ > kInlineChildCount_) ? overflow_children_.data() : inline_children_;
+}
+
+const uint32_t* Tree::Node::child_indices() const {
+  return (child_count_ > kInlineChildCount_) ? overflow_children_.data() : inline_children_;
+}
+
+// Returns child_count_ if `child` isn't a child of this node.
+size_t Tree::Node::GetChildPosition(const Tree::Node* child) const {
+  return (child->parent_ == index_) ? child->position_ : child_count_;
+}
+
+void Tree::Node::AttachChild(size_t position, Tree::Node* child) {
+  // Find where the leaves of the child's subtree go in the leaf list. If this
+  // node has been a leaf so far, they take its place.
+  Tree::Node* prev = nullptr;
+  Tree::Node* next = nullptr;
+
+  if (leaf()) {
+    prev = prev_leaf();
+    next = next_leaf();
+    prev_leaf_ = Tree::kNullIndex_;
+    next_leaf_ = Tree::kNullIndex_;
+  } else if (position > 0) {
+    prev = children()[position - 1]->GetLastLeaf();
+    next = prev->next_leaf();
+  } else {
+    next = children().front()->GetFirstLeaf();
+    prev = next->prev_leaf();
+  }
+
+  LinkLeaves(prev, child->GetFirstLeaf());
+  LinkLeaves(child->GetLastLeaf(), next);
+
+  child->parent_ = index_;
+  InsertChildIndex(position, child->index_);
+  AddToLeafCounts(child->tiling_leaf_count_, child->floating_leaf_count_);
+}
+
+void Tree::Node::DetachChild(size_t position) {
+  Tree::Node* child = children()[position];
+  Tree::Node* first_leaf = child->GetFirstLeaf();
+  Tree::Node* last_leaf = child->GetLastLeaf();
+  Tree::Node* prev = first_leaf->prev_leaf();
+  Tree::Node* next = last_leaf->next_leaf();
+
+  first_leaf->prev_leaf_ = Tree::kNullIndex_;
+  last_leaf->next_leaf_ = Tree::kNullIndex_;
+
+  AddToLeafCounts(-child->tiling_leaf_count_, -child->floating_leaf_count_);
+  child->parent_ = Tree::kNullIndex_;
+  child->position_ = 0;
+  EraseChildIndex(position);
+
+  // If this node has lost its last child, it becomes a leaf itself.
+  if (leaf()) {
+    LinkLeaves(prev, this);
+    LinkLeaves(this, next);
+  } else {
+    LinkLeaves(prev, next);
+  }
+}
+
+void Tree::Node::LinkLeaves(Tree::Node* prev, Tree::Node* next) {
+  if (prev) {
+    prev->next_leaf_ = (next) ? next->index_ : Tree::kNullIndex_;
+  }
+  if (next) {
+    next->prev_leaf_ = (prev) ? prev->index_ : Tree::kNullIndex_;
+  }
+}
+
+void Tree::Node::InsertChildIndex(size_t position, uint32_t index) {
+  if (child_count_ == kInlineChildCount_) {
+    overflow_children_.assign(inline_children_, inline_children_ + kInlineChildCount_);
+  }
+
+  if (child_count_ >= kInlineChildCount_) {
+    overflow_children_.insert(overflow_children_.begin() + position, index);
+  } else {
+    std::copy_backward(inline_children_ + position, inline_children_ + child_count_,
+                       inline_children_ + child_count_ + 1);
+    inline_children_[position] = index;
+  }
+  child_count_++;
+
+  UpdateChildPositions(position);
+}
+
+void Tree::Node::EraseChildIndex(size_t position) {
+  if (child_count_ > kInlineChildCount_) {
+    overflow_children_.erase(overflow_children_.begin() + position);
+    if (child_count_ - 1 == kInlineChildCount_) {
+      std::copy(overflow_children_.begin(), overflow_children_.end(), inline_children_);
+      overflow_children_.clear();  // but keep its capacity
+    }
+  } else {
+    std::copy(inline_children_ + position + 1, inline_children_ + child_count_,
+              inline_children_ + position);
+  }
+  child_count_--;
+
+  UpdateChildPositions(position);
+}
+
+void Tree::Node::UpdateChildPositions(size_t begin) {
+  const uint32_t* indices = child_indices();
+  for (size_t i = begin; i < child_count_; i++) {
+    tree_->GetNode(indices[i])->position_ = i;
+  }
+}
+
+void Tree::NodeDeleter::operator()(Tree::Node* node) const {
+  node->tree_->FreeNode(node);
+}
+
+Tree::Children::Children(const Tree* tree, const uint32_t* indices, size_t size)
+    : tree_(tree), indices_(indices), size_(size) {}
+
+Tree::Children::Iterator Tree::Children::begin() const {
+  return Iterator(tree_, indices_);
+}
+
+Tree::Children::Iterator Tree::Children::end() const {
+  return Iterator(tree_, indices_ + size_);
+}
+
+Tree::Node* Tree::Children::operator[](size_t i) const {
+  return tree_->GetNode(indices_[i]);
+}
+
+Tree::Node* Tree::Children::front() const {
+  return tree_->GetNode(indices_[0]);
+}
+
+Tree::Node* Tree::Children::back() const {
+  return tree_->GetNode(indices_[size_ - 1]);
+}
+
+size_t Tree::Children::size() const {
+  return size_;
+}
+
+bool Tree::Children::empty() const {
+  return size_ == 0;
+}
+
+Tree::Children::Iterator::Iterator(const Tree* tree, const uint32_t* index)
+    : tree_(tree), index_(index) {}
+
+Tree::Node* Tree::Children::Iterator::operator*() const {
+  return tree_->GetNode(*index_);
+}
+
+Tree::Children::Iterator& Tree::Children::Iterator::operator++() {
+  ++index_;
+  return *this;
+}
+
+bool Tree::Children::Iterator::operator==(const Iterator& other) const {
+  return index_ == other.index_;
 }
 
-unique_ptr<Tree::Node>& Tree::Node::owning_pointer() const {
-  return *std::find_if(parent_->children_.begin(), parent_->children_.end(),
-                       [&](unique_ptr<Tree::Node>& node) { return node.get() == this; });
+bool Tree::Children::Iterator::operator!=(const Iterator& other) const {
+  return index_ != other.index_;
 }
 
 }  // namespace wmderland
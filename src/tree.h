@@ -2,13 +2,15 @@
 #ifndef WMDERLAND_TREE_H_
 #define WMDERLAND_TREE_H_
 
+#include <cstdint>
 #include <memory>
-#include <unordered_map>
 #include <vector>
 
 namespace wmderland {
 
 class Client;
+class SnapshotReader;
+class SnapshotWriter;
 
 enum class TilingDirection {
   UNSPECIFIED,
@@ -21,23 +23,65 @@ enum class TilingPosition {
   AFTER,
 };
 
+// The nodes of a Tree are allocated from a pool owned by the tree. The pool
+// consists of fixed-size chunks, so a node never moves once allocated, and the
+// nodes refer to each other by 32-bit indices into the pool rather than by
+// pointers. A node which has been freed is reused by the next allocation.
 class Tree {
  public:
-  Tree();
-  virtual ~Tree() = default;
+  class Node;
+
+  // Returns a detached node to the pool of its tree (along with its subtree).
+  struct NodeDeleter {
+    void operator()(Tree::Node* node) const;
+  };
+  using NodePtr = std::unique_ptr<Tree::Node, Tree::NodeDeleter>;
+
+  // A view of the children of a node. It doesn't allocate anything, but it
+  // is invalidated as soon as a child is added to or removed from the node.
+  class Children {
+   public:
+    class Iterator {
+     public:
+      Iterator(const Tree* tree, const uint32_t* index);
+      Tree::Node* operator*() const;
+      Iterator& operator++();
+      bool operator==(const Iterator& other) const;
+      bool operator!=(const Iterator& other) const;
+
+     private:
+      const Tree* tree_;
+      const uint32_t* index_;
+    };
+
+    Children(const Tree* tree, const uint32_t* indices, size_t size);
+
+    Iterator begin() const;
+    Iterator end() const;
+    Tree::Node* operator[](size_t i) const;
+    Tree::Node* front() const;
+    Tree::Node* back() const;
+    size_t size() const;
+    bool empty() const;
+
+   private:
+    const Tree* tree_;
+    const uint32_t* indices_;
+    size_t size_;
+  };
 
   class Node {
    public:
-    Node(std::unique_ptr<Client> client);
-    virtual ~Node();
+    Node();
+    virtual ~Node() = default;
 
-    void AddChild(std::unique_ptr<Tree::Node> child);
-    std::unique_ptr<Tree::Node> RemoveChild(Tree::Node* child);
-    void InsertChildAfter(std::unique_ptr<Tree::Node> child, Tree::Node* ref);
-    void InsertChildBeside(std::unique_ptr<Tree::Node> child, Tree::Node* ref,
+    void AddChild(Tree::NodePtr child);
+    Tree::NodePtr RemoveChild(Tree::Node* child);
+    void InsertChildAfter(Tree::NodePtr child, Tree::Node* ref);
+    void InsertChildBeside(Tree::NodePtr child, Tree::Node* ref,
                            TilingPosition tiling_position);
-    void InsertChildAboveChildren(std::unique_ptr<Tree::Node> child);
-    void InsertParent(std::unique_ptr<Tree::Node> parent);
+    void InsertChildAboveChildren(Tree::NodePtr child);
+    void InsertParent(Tree::NodePtr parent);
     void Swap(Tree::Node* destination);
     void Resize(double delta);
     void ResizeToRatio(double ratio);
@@ -48,39 +92,85 @@ class Tree {
 
     Tree::Node* GetLeftSibling() const;
     Tree::Node* GetRightSibling() const;
+    Tree::Node* GetFirstLeaf();
+    Tree::Node* GetLastLeaf();
 
-    std::vector<Tree::Node*> GetLeaves();
-    bool HasTilingClientsInSubtree();
+    bool HasTilingClientsInSubtree() const;
+    void UpdateLeafCounts();
 
-    std::vector<Tree::Node*> children() const;
+    Tree::Children children() const;
     Tree::Node* parent() const;
+    Tree::Node* prev_leaf() const;
+    Tree::Node* next_leaf() const;
     Client* client() const;
     TilingDirection tiling_direction() const;
     double ratio() const;
     bool leaf() const;
+    int tiling_leaf_count() const;
+    int floating_leaf_count() const;
+    int leaf_count() const;
 
-    void set_parent(Tree::Node* parent);
     void set_client(std::unique_ptr<Client> client);
     Client* release_client();
     void set_tiling_direction(TilingDirection tiling_direction);
-
-    static std::unordered_map<Client*, Tree::Node*> mapper_;
+    void set_ratio(double ratio);
 
    private:
     static const double min_ratio_;
-    void FitChildrenRatiosAfterInsertion(Tree::Node* inserted);
-    std::unique_ptr<Tree::Node>& owning_pointer() const;
+    static const size_t kInlineChildCount_ = 4;
 
-    std::vector<std::unique_ptr<Tree::Node>> children_;
-    Tree::Node* parent_;
+    void FitChildrenRatiosAfterInsertion(Tree::Node* inserted);
+    void AddToLeafCounts(int tiling_delta, int floating_delta);
+    static void LinkLeaves(Tree::Node* prev, Tree::Node* next);
+
+    // All structural changes go through these two, which keep the child
+    // indices, positions, leaf counts and the leaf list consistent.
+    void AttachChild(size_t position, Tree::Node* child);
+    void DetachChild(size_t position);
+
+    // Up to kInlineChildCount_ children are stored in the node itself, and
+    // more than that are stored in overflow_children_.
+    uint32_t* child_indices();
+    const uint32_t* child_indices() const;
+    size_t GetChildPosition(const Tree::Node* child) const;
+    void InsertChildIndex(size_t position, uint32_t index);
+    void EraseChildIndex(size_t position);
+    void UpdateChildPositions(size_t begin);
+
+    Tree* tree_;
+    uint32_t index_;
+    uint32_t parent_;
+    uint32_t position_;  // the index of this node among its siblings
+    uint32_t child_count_;
+    uint32_t inline_children_[kInlineChildCount_];
+    std::vector<uint32_t> overflow_children_;
 
     std::unique_ptr<Client> client_;
     TilingDirection tiling_direction_;
     double ratio_;
+
+    // The number of leaves in this subtree which hold a tiling/floating client.
+    // They are kept up to date whenever a subtree is attached or detached, a
+    // client is set or released, or a client is floated or tiled.
+    int tiling_leaf_count_;
+    int floating_leaf_count_;
+
+    // The leaves of the whole tree are threaded into a doubly linked list in
+    // DFS order, and the leaves of any subtree form a contiguous run of it.
+    // An internal node which has lost all its children is a leaf too.
+    uint32_t prev_leaf_;
+    uint32_t next_leaf_;
+
+    friend class Tree;
+    friend struct Tree::NodeDeleter;
   };
 
+  Tree();
+  virtual ~Tree() = default;
+
+  Tree::NodePtr NewNode(std::unique_ptr<Client> client = nullptr);
+
   Tree::Node* GetTreeNode(Client* client) const;
-  std::vector<Tree::Node*> GetLeaves() const;
 
   void Normalize();
 
@@ -88,14 +178,26 @@ class Tree {
   Tree::Node* current_node() const;
   void set_current_node(Tree::Node* node);
 
-  std::string Serialize() const;
-  void Deserialize(std::string data);
+  void Serialize(SnapshotWriter* writer) const;
+  void Deserialize(SnapshotReader* reader);
 
  private:
-  void DfsCleanUpHelper(Tree::Node* node) const;
-  void DfsSerializeHelper(Tree::Node* node, std::string& data) const;
+  static const uint32_t kNullIndex_;
+  static const int kChunkShift_ = 6;
+  static const uint32_t kChunkSize_ = 1 << kChunkShift_;
+
+  Tree::Node* GetNode(uint32_t index) const;
+  Tree::Node* GetNodeOrNull(uint32_t index) const;
+  void FreeNode(Tree::Node* node);
+
+  void DfsSerializeHelper(Tree::Node* node, SnapshotWriter* writer) const;
+  void DfsDeserializeHelper(Tree::Node* node, SnapshotReader* reader);
+
+  std::vector<std::unique_ptr<Tree::Node[]>> chunks_;
+  std::vector<uint32_t> free_indices_;
+  uint32_t allocated_count_;
 
-  std::unique_ptr<Tree::Node> root_node_;
+  uint32_t root_;
   Tree::Node* current_node_;
 };
 
@@ -1,19 +1,34 @@
 // Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
 #include "util.h"
 
+extern "C" {
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+}
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 #include <sstream>
 
 #include "log.h"
+#include "query.h"
 
 using std::pair;
 using std::size_t;
 using std::string;
 using std::vector;
 
+extern "C" char** environ;
+
 namespace {
 Display* dpy;
 wmderland::Properties* prop;
 Window root_window;
+thread_local unsigned long allocation_count;  // see sys_utils::GetAllocationCount()
 }  // namespace
 
 namespace wmderland {
@@ -27,50 +42,25 @@ void Init(Display* dpy, Properties* prop, Window root_window) {
 }
 
 // Get the XWindowAttributes of a window.
+// To query multiple windows, use query::WindowAttributesCookie directly.
 XWindowAttributes GetXWindowAttributes(Window window) {
-  XWindowAttributes ret;
-  XGetWindowAttributes(dpy, window, &ret);
-  return ret;
+  return query::WindowAttributesCookie(window).Get();
 }
 
 // Get the XSizeHints of a window.
 XSizeHints GetWmNormalHints(Window window) {
-  XSizeHints hints;
-  long msize;
-  XGetWMNormalHints(dpy, window, &hints, &msize);
-  return hints;
+  return query::GetWindowInfo(window).normal_hints;
 }
 
 // Get the XClassHint (which contains res_class and res_name) of a window.
 pair<string, string> GetXClassHint(Window window) {
-  XClassHint hint;
-
-  if (XGetClassHint(dpy, window, &hint)) {
-    static const string undefined = "undefined";
-    string res_class = (hint.res_class) ? hint.res_class : undefined;
-    string res_name = (hint.res_name) ? hint.res_name : undefined;
-
-    if (hint.res_class) {
-      XFree(hint.res_class);
-    }
-    if (hint.res_name) {
-      XFree(hint.res_name);
-    }
-    return std::make_pair(res_class, res_name);
-  }
-
-  return std::make_pair("", "");
+  const query::WindowInfo& info = query::GetWindowInfo(window);
+  return std::make_pair(info.res_class, info.res_name);
 }
 
 // Get the utf8string in _NET_WM_NAME property.
 string GetNetWmName(Window window) {
-  XTextProperty name;
-  if (!XGetTextProperty(dpy, window, &name, prop->net[atom::NET_WM_NAME]) || !name.nitems) {
-    return "";
-  }
-  string ret(reinterpret_cast<char*>(name.value));
-  XFree(name.value);
-  return ret;
+  return query::GetWindowInfo(window).net_wm_name;
 }
 
 // Get the WM_NAME (i.e., the window title) of a window.
@@ -126,26 +116,16 @@ Atom* GetWindowProperty(Window window, Atom property, unsigned long* atom_len) {
 
 // Check if the property of window w contains the target atom.
 bool WindowPropertyHasAtom(Window window, Atom property, Atom target_atom) {
-  unsigned long atom_len = 0;
-  Atom* atoms = GetWindowProperty(window, property, &atom_len);
-
-  for (int i = 0; atoms && i < (int)atom_len; i++) {
-    if (atoms[i] && atoms[i] == target_atom) {
-      XFree(atoms);
-      return true;
-    }
-  }
-  XFree(atoms);
-  return false;
+  query::PropertyCookie cookie(window, property, XA_ATOM, 1024);
+  return query::HasAtom(cookie, target_atom);
 }
 
 bool HasNetWmStateFullscreen(Window window) {
-  return WindowPropertyHasAtom(window, prop->net[atom::NET_WM_STATE],
-                               prop->net[atom::NET_WM_STATE_FULLSCREEN]);
+  return query::GetWindowInfo(window).HasNetWmState(prop->net[atom::NET_WM_STATE_FULLSCREEN]);
 }
 
 bool IsWindowOfType(Window window, Atom type_atom) {
-  return WindowPropertyHasAtom(window, prop->net[atom::NET_WM_WINDOW_TYPE], type_atom);
+  return query::GetWindowInfo(window).IsWindowOfType(type_atom);
 }
 
 bool IsDock(Window window) {
@@ -253,11 +233,25 @@ void ExecuteCmd(string cmd) {
   }
 
   string_utils::Strip(cmd);
-  if (cmd.back() != '&') {
-    cmd.push_back('&');
-  }
 
-  if (system(cmd.c_str())) {
+  // The WM blocks a few signals in order to receive them via a signalfd, and
+  // the children must not inherit that signal mask. We don't wait for the
+  // child here; it is reaped when the WM receives SIGCHLD.
+  sigset_t empty_mask;
+  sigemptyset(&empty_mask);
+
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setsigmask(&attr, &empty_mask);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+  pid_t pid;
+  const char* argv[] = {"/bin/sh", "-c", cmd.c_str(), nullptr};
+  int ret =
+      posix_spawn(&pid, argv[0], nullptr, &attr, const_cast<char* const*>(argv), environ);
+  posix_spawnattr_destroy(&attr);
+
+  if (ret) {
     WM_LOG(ERROR, "Failed to execute: " + cmd);
   }
 }
@@ -266,6 +260,94 @@ void NotifySend(const string& msg, const string& level) {
   ExecuteCmd("notify-send -u " + level + " 'wmderland' '" + msg + "'");
 }
 
+bool WriteAll(int fd, const char* data, size_t size) {
+  for (size_t written = 0; written < size;) {
+    ssize_t n = write(fd, data + written, size - written);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    } else if (n == -1) {
+      WM_LOG_WITH_ERRNO("write() failed", errno);
+      return false;
+    }
+    written += n;
+  }
+  return true;
+}
+
+std::thread StartThread(std::function<void()> func) {
+  sigset_t all_signals;
+  sigset_t old_mask;
+  sigfillset(&all_signals);
+  pthread_sigmask(SIG_SETMASK, &all_signals, &old_mask);
+  std::thread thread(std::move(func));
+  pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+  return thread;
+}
+
+bool WriteFileAtomically(const string& filename, const string& data) {
+  const string tmp_filename = filename + ".tmp";
+  int fd = open(tmp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    WM_LOG_WITH_ERRNO("open() failed", errno);
+    return false;
+  }
+
+  if (!WriteAll(fd, data.data(), data.size())) {
+    close(fd);
+    unlink(tmp_filename.c_str());
+    return false;
+  }
+
+  // Make sure the data hits the disk before the rename does, or a crash might
+  // leave an empty file behind.
+  if (fsync(fd) == -1 || close(fd) == -1) {
+    WM_LOG_WITH_ERRNO("fsync() or close() failed", errno);
+    unlink(tmp_filename.c_str());
+    return false;
+  }
+
+  if (std::rename(tmp_filename.c_str(), filename.c_str()) == -1) {
+    WM_LOG_WITH_ERRNO("rename() failed", errno);
+    unlink(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+unsigned long GetAllocationCount() {
+  return allocation_count;
+}
+
 }  // namespace sys_utils
 
 }  // namespace wmderland
+
+#if COUNT_ALLOCATIONS
+void* operator new(size_t size) {
+  allocation_count++;
+  if (void* ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+#endif
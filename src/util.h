@@ -7,7 +7,9 @@ extern "C" {
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 }
+#include <functional>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "properties.h"
@@ -59,6 +61,21 @@ std::string ToAbsPath(const std::string& path);
 void ExecuteCmd(std::string cmd);
 void NotifySend(const std::string& msg, const std::string& level = NOTIFY_SEND_NORMAL);
 
+// Writes all of `data` to `fd`, retrying after short writes and EINTR.
+bool WriteAll(int fd, const char* data, size_t size);
+
+// Starts a thread with all signals blocked. The WM receives signals via a
+// signalfd, which only works as long as no thread accepts them.
+std::thread StartThread(std::function<void()> func);
+
+// Writes `data` to a temporary file and renames it to `filename`, so that the
+// file either has its old content or the new one, even if the WM crashes.
+bool WriteFileAtomically(const std::string& filename, const std::string& data);
+
+// The number of times operator new has been called by this thread so far, if
+// the WM is built with -DCOUNT_ALLOCATIONS=ON. Otherwise it is always 0.
+unsigned long GetAllocationCount();
+
 }  // namespace sys_utils
 
 }  // namespace wmderland
@@ -4,9 +4,17 @@
 extern "C" {
 #include <X11/Xatom.h>
 #include <X11/Xproto.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
 }
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
 #include <cstring>
 #include <iostream>
 #include <vector>
@@ -14,46 +22,44 @@ extern "C" {
 #include "client.h"
 #include "log.h"
 
-#define HAS_CLIENT_OR_RETURN(window)        \
-  do {                                      \
-    auto it = Client::mapper_.find(window); \
-    if (it == Client::mapper_.end()) {      \
-      return;                               \
-    }                                       \
+#define HAS_CLIENT_OR_RETURN(window)     \
+  do {                                   \
+    if (!Client::mapper_.Find(window)) { \
+      return;                            \
+    }                                    \
   } while (0)
 
-#define HAS_NO_CLIENT_OR_RETURN(window)     \
-  do {                                      \
-    auto it = Client::mapper_.find(window); \
-    if (it != Client::mapper_.end()) {      \
-      return;                               \
-    }                                       \
+#define HAS_NO_CLIENT_OR_RETURN(window) \
+  do {                                  \
+    if (Client::mapper_.Find(window)) { \
+      return;                           \
+    }                                   \
   } while (0)
 
 #define HAS_CLIENT_OR_RETURN_X(window, return_value) \
   do {                                               \
-    auto it = Client::mapper_.find(window);          \
-    if (it == Client::mapper_.end()) {               \
+    if (!Client::mapper_.Find(window)) {             \
       return return_value;                           \
     }                                                \
   } while (0)
 
 #define GET_CLIENT_OR_RETURN(window, client) \
   do {                                       \
-    auto it = Client::mapper_.find(window);  \
-    if (it == Client::mapper_.end()) {       \
+    client = Client::mapper_.Find(window);   \
+    if (!client) {                           \
       return;                                \
     }                                        \
-    client = it->second;                     \
   } while (0)
 
 using std::pair;
+using std::string;
 using std::tuple;
 using std::vector;
 
 namespace wmderland {
 
 bool WindowManager::is_running_ = true;
+const int WindowManager::kMaxEventBatchSize_ = 256;
 
 WindowManager* WindowManager::GetInstance() {
   Display* dpy = XOpenDisplay(None);
@@ -75,11 +81,34 @@ WindowManager::WindowManager(Display* dpy)
       cookie_(dpy_, prop_.get(), COOKIE_FILE),
       ipc_evmgr_(),
       snapshot_(SNAPSHOT_FILE),
+      journal_(dpy_, prop_.get(), JOURNAL_FILE),
       docks_(),
       notifications_(),
+      are_docks_mapped_(true),
+      dock_cookies_(),
       hidden_windows_(),
       workspaces_(),
-      current_() {
+      current_(),
+      needs_arrange_(),
+      arrange_request_count_(),
+      arrange_count_(),
+      arrange_allocation_count_(),
+      event_arena_(),
+      event_counts_(),
+      event_allocation_counts_(),
+      ignored_serial_ranges_(),
+      ignored_serial_ranges_head_(),
+      arrange_begin_serial_(),
+      client_list_(),
+      client_list_stacking_(),
+      is_client_list_dirty_(),
+      published_stacking_order_(),
+      is_layout_dirty_(true),
+      is_restarting_(),
+      event_loop_(),
+      signal_fd_(-1),
+      inotify_fd_(-1),
+      layout_template_timer_fd_(-1) {
   if (HasAnotherWmRunning()) {
     std::cerr << "Another window manager is already running." << std::endl;
     return;
@@ -91,21 +120,42 @@ WindowManager::WindowManager(Display* dpy)
 
   // Initialization.
   wm_utils::Init(dpy_, prop_.get(), root_window_);
+  query::Init(dpy_, prop_.get());
   mouse_->SetCursor(Mouse::CursorType::NORMAL);
   config_->Load();
   InitWorkspaces();
   InitProperties();
   InitXGrabs();
+  InitEventLoop();
   XSync(dpy_, false);
-
-  // Run the autostart_cmds defined in user's config.
-  for (const auto& cmd : config_->autostart_cmds()) {
-    sys_utils::ExecuteCmd(cmd);
-  }
 }
 
 WindowManager::~WindowManager() {
+  WM_LOG(INFO, "arranged windows " << arrange_count_ << " times, avoided "
+                                   << arrange_request_count_ - arrange_count_
+                                   << " redundant arrangements");
+#if COUNT_ALLOCATIONS
+  WM_LOG(INFO, "arranging windows made " << arrange_allocation_count_ << " heap allocations");
+  for (int type = 0; type < LASTEvent; type++) {
+    if (event_counts_[type]) {
+      WM_LOG(INFO, "handling " << event_counts_[type] << " events of type " << type << " made "
+                               << event_allocation_counts_[type] << " heap allocations");
+    }
+  }
+#endif
+  WM_LOG(INFO, "client requests sent/issued: " << Client::GetRequestStats());
+  WM_LOG(INFO, "woke up " << event_loop_.wakeup_count() << " times");
   WM_LOG(INFO, "releasing resources");
+
+  if (signal_fd_ != -1) {
+    close(signal_fd_);
+  }
+  if (inotify_fd_ != -1) {
+    close(inotify_fd_);
+  }
+  if (layout_template_timer_fd_ != -1) {
+    close(layout_template_timer_fd_);
+  }
   XCloseDisplay(dpy_);
 }
 
@@ -172,8 +222,9 @@ void WindowManager::InitProperties() {
   XChangeProperty(dpy_, root_window_, prop_->net[atom::NET_SUPPORTING_WM_CHECK], XA_WINDOW, 32,
                   PropModeReplace, reinterpret_cast<unsigned char*>(&wmcheckwin_), 1);
 
-  // Initialize NET_CLIENT_LIST to empty.
+  // Initialize NET_CLIENT_LIST and NET_CLIENT_LIST_STACKING to empty.
   XDeleteProperty(dpy_, root_window_, prop_->net[atom::NET_CLIENT_LIST]);
+  XDeleteProperty(dpy_, root_window_, prop_->net[atom::NET_CLIENT_LIST_STACKING]);
 
   // Set _NET_SUPPORTED to indicate which atoms are supported by this window
   // manager.
@@ -195,6 +246,46 @@ void WindowManager::InitProperties() {
                   PropModeReplace, reinterpret_cast<unsigned char*>(desktop_viewport_cord), 2);
 }
 
+void WindowManager::InitEventLoop() {
+  // The X events themselves are read by XPending() in Run().
+  event_loop_.Add(ConnectionNumber(dpy_), EPOLLIN, [](uint32_t) {});
+
+  event_loop_.Add(mouse_->drag_timer_fd(), EPOLLIN, [this](uint32_t) {
+    if (mouse_->ConsumeDragTimerExpiration()) {
+      OnDragTimerExpired();
+    }
+  });
+
+  // Block these signals so that they are delivered through signal_fd_.
+  // Note that sys_utils::ExecuteCmd() doesn't let the children inherit this mask.
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGHUP);
+
+  if (sigprocmask(SIG_BLOCK, &mask, nullptr) == -1) {
+    WM_LOG_WITH_ERRNO("sigprocmask() failed", errno);
+  } else if ((signal_fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) {
+    WM_LOG_WITH_ERRNO("signalfd() failed", errno);
+  } else {
+    event_loop_.Add(signal_fd_, EPOLLIN, [this](uint32_t) { OnSignal(); });
+  }
+
+  // Most editors save a file by replacing it, so watch its directory instead.
+  const string& config_filename = config_->filename();
+  const string config_dir = config_filename.substr(0, config_filename.find_last_of('/'));
+
+  if ((inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+    WM_LOG_WITH_ERRNO("inotify_init1() failed", errno);
+  } else if (inotify_add_watch(inotify_fd_, config_dir.c_str(),
+                               IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+    WM_LOG_WITH_ERRNO("inotify_add_watch() failed", errno);
+  } else {
+    event_loop_.Add(inotify_fd_, EPOLLIN, [this](uint32_t) { OnConfigFileChanged(); });
+  }
+}
+
 void WindowManager::InitWorkspaces() {
   char* names[workspaces_.size()];
 
@@ -214,56 +305,310 @@ void WindowManager::InitWorkspaces() {
   XSetTextProperty(dpy_, root_window_, &text_prop, prop_->net[atom::NET_DESKTOP_NAMES]);
 }
 
+// Runs the autostart_cmds defined in user's config. The layout templates are
+// applied to the empty workspaces first, so that the windows of these programs
+// are put right into their slots as they appear.
+void WindowManager::Autostart() {
+  bool has_layout_templates = false;
+  for (const auto& workspace : workspaces_) {
+    if (const LayoutTemplate* layout_template = config_->GetLayoutTemplate(workspace->id())) {
+      workspace->ApplyLayoutTemplate(*layout_template);
+      has_layout_templates = true;
+    }
+  }
+
+  if (has_layout_templates) {
+    ArmLayoutTemplateTimer();
+  }
+
+  for (const auto& cmd : config_->autostart_cmds()) {
+    sys_utils::ExecuteCmd(cmd);
+  }
+}
+
+// The layout templates only apply to the windows launched at startup. The slots
+// which are still free after LAYOUT_TEMPLATE_TIMEOUT are given up, so that a
+// window opened later is neither sent to a workspace the user isn't looking at
+// nor leaves a gap for a window which never comes.
+void WindowManager::ArmLayoutTemplateTimer() {
+  layout_template_timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (layout_template_timer_fd_ == -1) {
+    WM_LOG_WITH_ERRNO("timerfd_create() failed", errno);
+    OnLayoutTemplateTimerExpired();
+    return;
+  }
+
+  struct itimerspec spec;
+  std::memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = LAYOUT_TEMPLATE_TIMEOUT;
+
+  if (timerfd_settime(layout_template_timer_fd_, 0, &spec, nullptr) == -1) {
+    WM_LOG_WITH_ERRNO("timerfd_settime() failed", errno);
+    OnLayoutTemplateTimerExpired();
+    return;
+  }
+  event_loop_.Add(layout_template_timer_fd_, EPOLLIN,
+                  [this](uint32_t) { OnLayoutTemplateTimerExpired(); });
+}
+
+void WindowManager::OnLayoutTemplateTimerExpired() {
+  if (layout_template_timer_fd_ != -1) {
+    event_loop_.Remove(layout_template_timer_fd_);
+    close(layout_template_timer_fd_);
+    layout_template_timer_fd_ = -1;
+  }
+
+  for (const auto& workspace : workspaces_) {
+    workspace->DropLayoutTemplate();
+  }
+  ArrangeWindows();
+}
+
+// Manages the windows which have been mapped before the WM has started (e.g.,
+// by another WM), except for those restored from a snapshot or the journal.
+// All the windows are queried in a few round trips, and they are arranged
+// only once, in Run().
+void WindowManager::AdoptWindows() {
+  const auto begin_time = std::chrono::steady_clock::now();
+
+  Window root = None;
+  Window parent = None;
+  Window* children = nullptr;
+  unsigned int child_count = 0;
+  if (!XQueryTree(dpy_, root_window_, &root, &parent, &children, &child_count)) {
+    return;
+  }
+
+  vector<Window> windows;
+  vector<query::WindowAttributesCookie> cookies;
+  windows.reserve(child_count);
+  cookies.reserve(child_count);
+
+  for (unsigned int i = 0; i < child_count; i++) {
+    const Window window = children[i];
+    if (window != wmcheckwin_ && !Client::mapper_.Find(window) &&
+        docks_.find(window) == docks_.end() &&
+        notifications_.find(window) == notifications_.end()) {
+      windows.push_back(window);
+      cookies.emplace_back(window);
+    }
+  }
+  if (children) {
+    XFree(children);
+  }
+
+  // Only the windows which are visible and aren't override-redirect (e.g.,
+  // popup menus) can be managed.
+  size_t viewable_count = 0;
+  for (size_t i = 0; i < windows.size(); i++) {
+    const XWindowAttributes& attr = cookies[i].Get();
+    if (!attr.override_redirect && attr.map_state == IsViewable) {
+      windows[viewable_count++] = windows[i];
+    }
+  }
+  windows.resize(viewable_count);
+  query::PrefetchWindowInfo(windows);
+
+  // Same as OnMapRequest() and OnMapNotify(), except that the windows are
+  // already mapped.
+  for (const auto window : windows) {
+    const query::WindowInfo& info = query::GetWindowInfo(window);
+    const Config::WindowRules rules = config_->GetWindowRules(info);
+
+    if (rules.should_prohibit) {
+      continue;
+    } else if (info.IsWindowOfType(prop_->net[atom::NET_WM_WINDOW_TYPE_DOCK])) {
+      docks_.insert(window);
+      are_docks_mapped_ = true;
+      continue;
+    } else if (info.IsWindowOfType(prop_->net[atom::NET_WM_WINDOW_TYPE_NOTIFICATION])) {
+      notifications_.insert(window);
+      continue;
+    }
+
+    wm_utils::SetWindowWmState(window, NormalState);
+    Manage(window, rules);
+
+    Client* c = Client::mapper_.Find(window);
+    c->SelectInput(EnterWindowMask | PropertyChangeMask);
+
+    // A window which belongs to another workspace must be hidden.
+    if (c->workspace() != workspaces_[current_].get()) {
+      c->Unmap();
+    }
+  }
+
+  if (!windows.empty()) {
+    Client::InvalidateStackingOrder();
+    ArrangeWindows();
+  }
+
+  const auto elapsed = std::chrono::steady_clock::now() - begin_time;
+  WM_LOG(INFO, "adopted " << windows.size() << " existing windows in "
+                          << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()
+                          << "us");
+}
+
 void WindowManager::Run() {
   XEvent event;
 
+  // After a restart (or a recovery from a snapshot), the WM has been
+  // unresponsive since the snapshot was taken until it handles the first event.
+  uint64_t snapshot_time = snapshot_.saved_at();
+
   while (is_running_) {
-    // Retrieve and dispatch next X event.
-    XNextEvent(dpy_, &event);
+    // Arrange the windows (if any handler has asked for it) before going to
+    // sleep.
+    ArrangeWindowsIfNeeded();
+    UpdateClientListIfNeeded();
+    JournalLayoutIfNeeded();
+    event_arena_.Reset();
+
+    // XPending() flushes our requests and reads whatever has arrived on the X
+    // connection. Xlib may have already queued some events while it was
+    // waiting for a reply, in which case the connection won't be readable
+    // anymore, so we can only go to sleep once Xlib's own queue is empty.
+    if (!XPending(dpy_)) {
+      event_loop_.Wait();
+      continue;
+    }
 
-    switch (event.type) {
-      case ConfigureRequest:
-        OnConfigureRequest(event.xconfigurerequest);
-        break;
-      case MapRequest:
-        OnMapRequest(event.xmaprequest);
-        break;
-      case MapNotify:
-        OnMapNotify(event.xmap);
-        break;
-      case UnmapNotify:
-        OnUnmapNotify(event.xunmap);
-        break;
-      case DestroyNotify:
-        OnDestroyNotify(event.xdestroywindow);
-        break;
-      case KeyPress:
-        OnKeyPress(event.xkey);
-        break;
-      case ButtonPress:
-        OnButtonPress(event.xbutton);
-        break;
-      case ButtonRelease:
-        OnButtonRelease(event.xbutton);
-        break;
-      case MotionNotify:
-        OnMotionNotify(event.xbutton);
-        break;
-      case EnterNotify:
-        OnEnterNotify(event.xcrossing);
-        break;
-      case ClientMessage:
-        OnClientMessage(event.xclient);
-        break;
-      default:
-        // Unhandled X Events are ignored.
-        break;
+    // Handle the events which are already queued as one batch. The batch size
+    // is capped so that a continuous stream of events can't postpone the
+    // arrangement forever.
+    for (int i = 0; is_running_ && i < kMaxEventBatchSize_ && XPending(dpy_); i++) {
+      XNextEvent(dpy_, &event);
+
+      const unsigned long allocation_count = sys_utils::GetAllocationCount();
+      HandleXEvent(event);
+
+      if (snapshot_time) {
+        const auto latency = std::chrono::steady_clock::now().time_since_epoch() -
+            std::chrono::nanoseconds(snapshot_time);
+        WM_LOG(INFO, "handled the first event "
+                         << std::chrono::duration_cast<std::chrono::microseconds>(latency).count()
+                         << "us after the snapshot was taken");
+        snapshot_time = 0;
+      }
+
+      // Events of extensions have types beyond LASTEvent.
+      if (event.type < LASTEvent) {
+        const unsigned long allocations = sys_utils::GetAllocationCount() - allocation_count;
+        event_counts_[event.type]++;
+        event_allocation_counts_[event.type] += allocations;
+      }
+    }
+  }
+
+  // The WM is exiting normally, so there will be nothing to recover. When
+  // restarting, the journal is kept in case the new process fails to start.
+  if (!is_restarting_) {
+    journal_.Discard();
+  }
+}
+
+void WindowManager::HandleXEvent(const XEvent& event) {
+  switch (event.type) {
+    case ConfigureRequest:
+      OnConfigureRequest(event.xconfigurerequest);
+      break;
+    case MapRequest:
+      OnMapRequest(event.xmaprequest);
+      break;
+    case MapNotify:
+      OnMapNotify(event.xmap);
+      break;
+    case UnmapNotify:
+      OnUnmapNotify(event.xunmap);
+      break;
+    case DestroyNotify:
+      OnDestroyNotify(event.xdestroywindow);
+      break;
+    case KeyPress:
+      OnKeyPress(event.xkey);
+      break;
+    case ButtonPress:
+      OnButtonPress(event.xbutton);
+      break;
+    case ButtonRelease:
+      OnButtonRelease(event.xbutton);
+      break;
+    case MotionNotify:
+      OnMotionNotify(event.xbutton);
+      break;
+    case EnterNotify:
+      OnEnterNotify(event.xcrossing);
+      break;
+    case ClientMessage:
+      OnClientMessage(event.xclient);
+      break;
+    case PropertyNotify:
+      query::OnPropertyNotify(event.xproperty);
+      break;
+    default:
+      // Unhandled X Events are ignored.
+      break;
+  }
+}
+
+// Marks current workspace as dirty. The windows will be arranged after
+// the current batch of XEvents has been handled.
+void WindowManager::ArrangeWindows() {
+  // The handler which has made current workspace dirty may have already
+  // sent some requests (e.g., unmapping a client), so start counting here.
+  if (!needs_arrange_) {
+    arrange_begin_serial_ = NextRequest(dpy_);
+  }
+  arrange_request_count_++;
+  needs_arrange_ = true;
+  is_layout_dirty_ = true;
+}
+
+void WindowManager::ArrangeWindowsIfNeeded() {
+  if (!needs_arrange_) {
+    return;
+  }
+
+  needs_arrange_ = false;
+  arrange_count_++;
+
+  const unsigned long allocation_count = sys_utils::GetAllocationCount();
+  ArrangeWindowsNow();
+  arrange_allocation_count_ += sys_utils::GetAllocationCount() - allocation_count;
+  IgnoreEnterNotifySince(arrange_begin_serial_);
+}
+
+void WindowManager::IgnoreEnterNotifySince(unsigned long serial) {
+  const unsigned long last_serial = NextRequest(dpy_) - 1;
+  if (last_serial < serial) {
+    return;  // nothing has been sent.
+  }
+
+  ignored_serial_ranges_head_ = (ignored_serial_ranges_head_ + 1) % kIgnoredSerialRangeCount_;
+  ignored_serial_ranges_[ignored_serial_ranges_head_] = {serial, last_serial};
+
+  // Every event carries the serial of the last request processed before it,
+  // so without a newer request, the EnterNotify events caused by the user
+  // moving the pointer afterwards would fall into this range as well.
+  XNoOp(dpy_);
+}
+
+bool WindowManager::ShouldIgnoreEnterNotify(const XEnterWindowEvent& e) const {
+  // Pointer grabs (e.g., dragging a window) also generate crossing events.
+  if (e.mode != NotifyNormal) {
+    return true;
+  }
+
+  for (const auto& range : ignored_serial_ranges_) {
+    if (e.serial >= range.first && e.serial <= range.second) {
+      return true;
     }
   }
+  return false;
 }
 
 // Arranges the windows in current workspace to how they ought to be.
-void WindowManager::ArrangeWindows() const {
+void WindowManager::ArrangeWindowsNow() {
   Client* focused_client = workspaces_[current_]->GetFocusedClient();
 
   if (!focused_client) {
@@ -274,9 +619,6 @@ void WindowManager::ArrangeWindows() const {
 
   wm_utils::SetNetActiveWindow(focused_client->window());
 
-  // Pause receiving OnEnterWindowEvents for all windows in current workspace.
-  workspaces_[current_]->DisableFocusFollowsMouse();
-
   if (workspaces_[current_]->is_fullscreen()) {
     UnmapDocks();
     // At this point, we have to consider two cases:
@@ -301,51 +643,69 @@ void WindowManager::ArrangeWindows() const {
     workspaces_[current_]->RaiseAllFloatingClients();
     RaiseNotifications();
   }
-
-  // Resume receiving OnEnterWindowEvents for all windows in current workspace.
-  workspaces_[current_]->EnableFocusFollowsMouse();
 }
 
 void WindowManager::OnConfigureRequest(const XConfigureRequestEvent& e) {
-  XWindowChanges changes;
-  changes.x = e.x;
-  changes.y = e.y;
-  changes.width = e.width;
-  changes.height = e.height;
-  changes.border_width = e.border_width;
-  changes.sibling = e.above;
-  changes.stack_mode = e.detail;
-  XConfigureWindow(dpy_, e.window, e.value_mask, &changes);
+  // If this window is managed, let its Client keep track of the changes.
+  Client* c = Client::mapper_.Find(e.window);
+  if (c) {
+    c->Configure(e);
+  } else {
+    XWindowChanges changes;
+    changes.x = e.x;
+    changes.y = e.y;
+    changes.width = e.width;
+    changes.height = e.height;
+    changes.border_width = e.border_width;
+    changes.sibling = e.above;
+    changes.stack_mode = e.detail;
+    XConfigureWindow(dpy_, e.window, e.value_mask, &changes);
+
+    if (e.value_mask & CWStackMode) {
+      Client::InvalidateStackingOrder();
+    }
+  }
 
   if (hidden_windows_.find(e.window) != hidden_windows_.end()) {
     hidden_windows_.erase(e.window);
-    Manage(e.window);
+    Manage(e.window, config_->GetWindowRules(query::GetWindowInfo(e.window)));
   }
 
   ArrangeWindows();
 }
 
 void WindowManager::OnMapRequest(const XMapRequestEvent& e) {
+  // Everything we need to know about this window is fetched in one round trip.
+  const query::WindowInfo& info = query::GetWindowInfo(e.window);
+  const Config::WindowRules rules = config_->GetWindowRules(info);
+
   // If user has requested to prohibit this window from being mapped,
   // then don't map it.
-  if (config_->ShouldProhibit(e.window)) {
+  if (rules.should_prohibit) {
     return;
   }
 
   // If this window is a dock (or bar), map it, add it to docks_
   // and arrange the workspace.
-  if (wm_utils::IsDock(e.window) && docks_.find(e.window) == docks_.end()) {
+  if (info.IsWindowOfType(prop_->net[atom::NET_WM_WINDOW_TYPE_DOCK]) &&
+      docks_.find(e.window) == docks_.end()) {
     XMapWindow(dpy_, e.window);
     docks_.insert(e.window);
+    are_docks_mapped_ = true;
+    Client::InvalidateStackingOrder();
     workspaces_[current_]->Tile(GetTilingArea());
     return;
   }
 
   wm_utils::SetWindowWmState(e.window, NormalState);
-  Manage(e.window);
+  Manage(e.window, rules);
 }
 
 void WindowManager::OnMapNotify(const XMapEvent& e) {
+  // Whatever has just been mapped (e.g., an override-redirect popup) is now
+  // on top of the stack.
+  Client::InvalidateStackingOrder();
+
   // Checking if a window is a notification in OnMapRequest() will fail
   // (especially dunst), So we perform the check here (after the window is
   // mapped) instead.
@@ -357,7 +717,7 @@ void WindowManager::OnMapNotify(const XMapEvent& e) {
   Client* c = nullptr;
   GET_CLIENT_OR_RETURN(e.window, c);
 
-  c->SelectInput(EnterWindowMask);
+  c->SelectInput(EnterWindowMask | PropertyChangeMask);
   c->set_mapped(true);
 }
 
@@ -368,7 +728,7 @@ void WindowManager::OnUnmapNotify(const XUnmapEvent& e) {
   Client* c = nullptr;
   GET_CLIENT_OR_RETURN(e.window, c);
 
-  c->SelectInput(None);
+  c->SelectInput(PropertyChangeMask);
   c->set_mapped(false);
 
   if (c->has_unmap_req_from_wm()) {
@@ -380,14 +740,16 @@ void WindowManager::OnUnmapNotify(const XUnmapEvent& e) {
 }
 
 void WindowManager::OnDestroyNotify(const XDestroyWindowEvent& e) {
+  // The window is gone, and so are its properties.
+  query::ForgetWindowInfo(e.window);
+
   if (docks_.find(e.window) != docks_.end()) {
     docks_.erase(e.window);
     workspaces_[current_]->Tile(GetTilingArea());
     return;
   }
 
-  if (wm_utils::IsNotification(e.window)) {
-    notifications_.erase(e.window);
+  if (notifications_.erase(e.window)) {
     return;
   }
 
@@ -417,12 +779,11 @@ void WindowManager::OnButtonPress(const XButtonEvent& e) {
 
   if (c->is_floating()) {
     c->Raise();
-    c->set_attr_cache(c->GetXWindowAttributes());
+    c->set_geometry_cache(c->GetGeometry());
   } else if (e.button != Mouse::Button::LEFT) {
     return;
   }
 
-  c->workspace()->DisableFocusFollowsMouse();
   mouse_->btn_pressed_event_ = e;
   mouse_->SetCursor(static_cast<Mouse::CursorType>(e.button));
 }
@@ -432,11 +793,15 @@ void WindowManager::OnButtonRelease(const XButtonEvent& e) {
   GET_CLIENT_OR_RETURN(mouse_->btn_pressed_event_.subwindow, c);
 
   assert(!c->is_fullscreen());
-  c->workspace()->EnableFocusFollowsMouse();
+
+  // Make sure the last motion event is applied before we save its geometry.
+  if (mouse_->has_pending_motion_) {
+    DragFloatingClient(mouse_->btn_motion_event_);
+  }
+  mouse_->DisarmDragTimer();
 
   if (c->is_floating()) {
-    XWindowAttributes attr = wm_utils::GetXWindowAttributes(mouse_->btn_pressed_event_.subwindow);
-    cookie_.Put(c->window(), {attr.x, attr.y, attr.width, attr.height});
+    cookie_.Put(c->window(), c->GetGeometry());
   } else {
     tuple<Window, AreaType, TilingDirection, TilingPosition> drop_location =
         GetDropLocation(e);
@@ -458,15 +823,64 @@ void WindowManager::OnMotionNotify(const XButtonEvent& e) {
     return;
   }
 
-  const XWindowAttributes& attr = c->attr_cache();
+  // Motion compression: if more motion events are already queued up behind
+  // this one, skip to the latest of them.
+  XEvent latest;
+  latest.xbutton = e;
+  while (XEventsQueued(dpy_, QueuedAlready)) {
+    XEvent next;
+    XPeekEvent(dpy_, &next);
+    if (next.type != MotionNotify) {
+      break;
+    }
+    XNextEvent(dpy_, &latest);
+  }
+
+  // If the drag refresh rate is capped and the floating window has been
+  // moved/resized within the current frame, keep the event until the drag
+  // timer expires. Otherwise, apply it now and start a new frame.
+  if (mouse_->is_drag_timer_armed()) {
+    mouse_->btn_motion_event_ = latest.xbutton;
+    mouse_->has_pending_motion_ = true;
+    return;
+  }
+
+  DragFloatingClient(latest.xbutton);
+  mouse_->ArmDragTimer(config_->drag_refresh_rate());
+}
+
+void WindowManager::OnDragTimerExpired() {
+  if (!mouse_->has_pending_motion_) {
+    return;  // the pointer hasn't moved during the last frame.
+  }
+
+  DragFloatingClient(mouse_->btn_motion_event_);
+  mouse_->ArmDragTimer(config_->drag_refresh_rate());
+}
+
+// Moves/resizes the floating client being dragged according to the
+// distance between the pointer and where the button was pressed.
+void WindowManager::DragFloatingClient(const XButtonEvent& e) {
+  mouse_->has_pending_motion_ = false;
+
+  Client* c = nullptr;
+  GET_CLIENT_OR_RETURN(mouse_->btn_pressed_event_.subwindow, c);
+
+  if (!c->is_floating()) {
+    return;
+  }
+
+  const Client::Area& geometry = c->geometry_cache();
   const XButtonEvent& btn_pressed_event = mouse_->btn_pressed_event_;
 
   int xdiff = e.x - btn_pressed_event.x;
   int ydiff = e.y - btn_pressed_event.y;
-  int new_x = attr.x + ((btn_pressed_event.button == Mouse::Button::LEFT) ? xdiff : 0);
-  int new_y = attr.y + ((btn_pressed_event.button == Mouse::Button::LEFT) ? ydiff : 0);
-  int new_width = attr.width + ((btn_pressed_event.button == Mouse::Button::RIGHT) ? xdiff : 0);
-  int new_height = attr.height + ((btn_pressed_event.button == Mouse::Button::RIGHT) ? ydiff : 0);
+  int new_x = geometry.x + ((btn_pressed_event.button == Mouse::Button::LEFT) ? xdiff : 0);
+  int new_y = geometry.y + ((btn_pressed_event.button == Mouse::Button::LEFT) ? ydiff : 0);
+  int new_width =
+      geometry.w + ((btn_pressed_event.button == Mouse::Button::RIGHT) ? xdiff : 0);
+  int new_height =
+      geometry.h + ((btn_pressed_event.button == Mouse::Button::RIGHT) ? ydiff : 0);
 
   c->MoveResize(new_x, new_y, new_width, new_height);
 }
@@ -476,11 +890,12 @@ void WindowManager::OnEnterNotify(const XEnterWindowEvent& e) {
     return;
   }
 
-  HAS_CLIENT_OR_RETURN(e.window);
+  if (ShouldIgnoreEnterNotify(e)) {
+    return;
+  }
 
-  workspaces_[current_]->UnsetFocusedClient();
-  workspaces_[current_]->SetFocusedClient(e.window);
-  ArrangeWindows();
+  HAS_CLIENT_OR_RETURN(e.window);
+  FocusClient(e.window);
 }
 
 void WindowManager::OnClientMessage(const XClientMessageEvent& e) {
@@ -505,12 +920,69 @@ void WindowManager::OnClientMessage(const XClientMessageEvent& e) {
   }
 }
 
+// Handles the signals which have arrived on signal_fd_ (see InitEventLoop()).
+void WindowManager::OnSignal() {
+  struct signalfd_siginfo info;
+
+  while (read(signal_fd_, &info, sizeof(info)) == sizeof(info)) {
+    switch (info.ssi_signo) {
+      case SIGCHLD:
+        // Several children may have exited while SIGCHLD was pending.
+        while (waitpid(-1, nullptr, WNOHANG) > 0) {
+          continue;
+        }
+        break;
+      case SIGTERM:
+        is_running_ = false;
+        break;
+      case SIGHUP:
+        ReloadConfig();
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+// Reloads the config (with auto_reload) once inotify_fd_ reports it was saved.
+void WindowManager::OnConfigFileChanged() {
+  // The events are read in one go, so that saving the file (which may
+  // generate several events) triggers at most one reload.
+  alignas(struct inotify_event) char buf[4096];
+  const string& config_filename = config_->filename();
+  const string basename = config_filename.substr(config_filename.find_last_of('/') + 1);
+  bool has_changed = false;
+  ssize_t len = 0;
+
+  while ((len = read(inotify_fd_, buf, sizeof(buf))) > 0) {
+    for (char* ptr = buf; ptr < buf + len;) {
+      const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+      if (event->len && basename == event->name) {
+        has_changed = true;
+      }
+      ptr += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  if (has_changed && config_->auto_reload()) {
+    ReloadConfig();
+  }
+}
+
+void WindowManager::ReloadConfig() {
+  sys_utils::NotifySend("Reloading config...");
+  UndoXGrabs();  // XUngrabKey(), XUngrabButton()
+  config_->Load();
+  InitXGrabs();  // XGrabKey(), XGrabButton()
+  OnConfigReload();
+}
+
 // 1. Apply new border width and color to existing clients.
 // 2. Re-arrange windows in current workspace.
 // 3. Run all commands in config->autostart_cmds_on_reload_
 void WindowManager::OnConfigReload() {
   for (const auto& workspace : workspaces_) {
-    for (const auto client : workspace->GetClients()) {
+    for (const auto client : workspace->clients()) {
       client->SetBorderWidth(config_->border_width());
       client->SetBorderColor(config_->unfocused_color());
     }
@@ -531,28 +1003,51 @@ int WindowManager::OnWmDetected(Display*, XErrorEvent*) {
   return 0;  // the return value is ignored.
 }
 
-void WindowManager::Manage(Window window) {
+void WindowManager::Manage(Window window, const Config::WindowRules& rules) {
   // This window should NOT have a corresponding Client* in Client::mapper_ yet.
   // If we really found one, don't re-manage it.
   HAS_NO_CLIENT_OR_RETURN(window);
 
+  const query::WindowInfo& info = query::GetWindowInfo(window);
+
+  bool should_float = rules.should_float ||
+      info.IsWindowOfType(prop_->net[atom::NET_WM_WINDOW_TYPE_DIALOG]) ||
+      info.IsWindowOfType(prop_->net[atom::NET_WM_WINDOW_TYPE_SPLASH]) ||
+      info.IsWindowOfType(prop_->net[atom::NET_WM_WINDOW_TYPE_UTILITY]);
+
+  bool should_fullscreen = rules.should_fullscreen ||
+      info.HasNetWmState(prop_->net[atom::NET_WM_STATE_FULLSCREEN]);
+
   // Spawn this window in the specified workspace if such rule exists,
-  // otherwise spawn it in current workspace.
-  int target = config_->GetSpawnWorkspaceId(window);
+  // otherwise in the workspace which has a slot reserved for it (if any) or
+  // in current workspace.
+  int target = rules.workspace_id;
+  bool has_slot = false;
+
+  if (!should_float && !should_fullscreen) {
+    for (const auto& workspace : workspaces_) {
+      if ((target == UNSPECIFIED_WORKSPACE || target == workspace->id()) &&
+          workspace->HasFreeSlot(info)) {
+        target = workspace->id();
+        has_slot = true;
+        break;
+      }
+    }
+  }
   if (target == UNSPECIFIED_WORKSPACE) {
     target = current_;
   }
 
   Client* prev_focused_client = workspaces_[target]->GetFocusedClient();
   workspaces_[target]->UnsetFocusedClient();
-  workspaces_[target]->Add(window);
-  UpdateClientList();  // update NET_CLIENT_LIST
-
-  bool should_float = config_->ShouldFloat(window) || wm_utils::IsDialog(window) ||
-      wm_utils::IsSplash(window) || wm_utils::IsUtility(window);
-
-  bool should_fullscreen =
-      config_->ShouldFullscreen(window) || wm_utils::HasNetWmStateFullscreen(window);
+  if (has_slot) {
+    workspaces_[target]->AddToSlot(window, info);
+  } else {
+    workspaces_[target]->Add(window);
+  }
+  client_list_.push_back(window);
+  is_client_list_dirty_ = true;
+  is_layout_dirty_ = true;
 
   workspaces_[target]->GetClient(window)->set_mapped(true);
   workspaces_[target]->GetClient(window)->set_floating(should_float);
@@ -590,7 +1085,9 @@ void WindowManager::Unmanage(Window window) {
   // Remove the corresponding client from the client tree.
   workspace->Remove(window);
   workspace->Normalize();
-  UpdateClientList();
+  client_list_.erase(std::remove(client_list_.begin(), client_list_.end(), window),
+                     client_list_.end());
+  is_client_list_dirty_ = true;
   ArrangeWindows();
 }
 
@@ -601,9 +1098,13 @@ void WindowManager::HandleAction(const Action& action) {
     case Action::Type::NAVIGATE_LEFT:
     case Action::Type::NAVIGATE_RIGHT:
     case Action::Type::NAVIGATE_UP:
-    case Action::Type::NAVIGATE_DOWN:
-      workspaces_[current_]->Navigate(action.type());
+    case Action::Type::NAVIGATE_DOWN: {
+      Client* c = workspaces_[current_]->Navigate(action.type());
+      if (c) {
+        FocusClient(c->window());
+      }
       break;
+    }
     case Action::Type::RESIZE_WIDTH:
     case Action::Type::RESIZE_HEIGHT:
       if (!focused_client || !focused_client->is_floating()) {
@@ -621,13 +1122,15 @@ void WindowManager::HandleAction(const Action& action) {
     case Action::Type::FLOAT_RESIZE_DOWN:
       if (!focused_client ||
           !focused_client->is_floating() || focused_client->is_fullscreen()) return;
-      workspaces_[current_]->DisableFocusFollowsMouse();
-      if (action.type() <= Action::Type::FLOAT_MOVE_DOWN) {
-        focused_client->Move(action);
-      } else {
-        focused_client->Resize(action);
+      {
+        const unsigned long serial = NextRequest(dpy_);
+        if (action.type() <= Action::Type::FLOAT_MOVE_DOWN) {
+          focused_client->Move(action);
+        } else {
+          focused_client->Resize(action);
+        }
+        IgnoreEnterNotifySince(serial);
       }
-      workspaces_[current_]->EnableFocusFollowsMouse();
       break;
     case Action::Type::RESIZE_SET_RATIO:
       workspaces_[current_]->ResizeTiledToRatio(std::stoi(action.argument()));
@@ -637,11 +1140,15 @@ void WindowManager::HandleAction(const Action& action) {
       workspaces_[current_]->ResizeDistributeRatios();
       ArrangeWindows();
       break;
+    // Nothing moves until the next window is added, but the journal has to
+    // record the new tiling direction now.
     case Action::Type::TILE_H:
       workspaces_[current_]->SetTilingDirection(TilingDirection::HORIZONTAL);
+      is_layout_dirty_ = true;
       break;
     case Action::Type::TILE_V:
       workspaces_[current_]->SetTilingDirection(TilingDirection::VERTICAL);
+      is_layout_dirty_ = true;
       break;
     case Action::Type::TOGGLE_FLOATING:
       if (!focused_client) return;
@@ -670,16 +1177,16 @@ void WindowManager::HandleAction(const Action& action) {
       is_running_ = false;
       break;
     case Action::Type::RELOAD:
-      sys_utils::NotifySend("Reloading config...");
-      UndoXGrabs();  // XUngrabKey(), XUngrabButton()
-      config_->Load();
-      InitXGrabs();  // XGrabKey(), XGrabButton()
-      OnConfigReload();
+      ReloadConfig();
       break;
     case Action::Type::DEBUG_CRASH:
       WM_LOG(INFO, "Debug crash on demand.");
       throw std::runtime_error("Debug crash");
       break;
+    case Action::Type::RESTART:
+      is_restarting_ = true;
+      is_running_ = false;
+      break;
     case Action::Type::EXEC:
       sys_utils::ExecuteCmd(action.argument());
       break;
@@ -702,6 +1209,32 @@ void WindowManager::GotoWorkspace(int next) {
                   PropModeReplace, reinterpret_cast<unsigned char*>(&next), 1);
 }
 
+// Moves the input focus to `window` without re-arranging current workspace.
+// Only the previously and the newly focused clients are touched.
+void WindowManager::FocusClient(Window window) {
+  Workspace* workspace = workspaces_[current_].get();
+  Client* c = workspace->GetClient(window);
+  if (!c || c == workspace->GetFocusedClient()) {
+    return;
+  }
+
+  workspace->UnsetFocusedClient();
+  workspace->SetFocusedClient(window);
+
+  // In fullscreen mode, only the focused client should be mapped.
+  if (workspace->is_fullscreen()) {
+    ArrangeWindows();
+    return;
+  }
+
+  // A floating client has just been raised, which may have covered
+  // the notifications.
+  if (c->is_floating()) {
+    RaiseNotifications();
+  }
+  wm_utils::SetNetActiveWindow(window);
+}
+
 void WindowManager::MoveWindowToWorkspace(Window window, int next) {
   Client* c = nullptr;
   GET_CLIENT_OR_RETURN(window, c);
@@ -751,13 +1284,14 @@ void WindowManager::SwapWindows(Window window0, Window window1) {
   workspaces_[current_]->Swap(window0, window1);
 
   // Also swap the coordinates of the windows. (Apply it if the window is floating.)
-  XWindowAttributes attr0 = c0->GetXWindowAttributes();
+  const Client::Area geometry0 = c0->GetGeometry();
+  const Client::Area geometry1 = c1->GetGeometry();
+
   if (c0->is_floating()) {
-    XWindowAttributes attr = c1->GetXWindowAttributes();
-    c0->MoveResize(attr.x, attr.y, attr.width, attr.height);
+    c0->MoveResize(geometry1.x, geometry1.y, geometry1.w, geometry1.h);
   }
   if (c1->is_floating()) {
-    c1->MoveResize(attr0.x, attr0.y, attr0.width, attr0.height);
+    c1->MoveResize(geometry0.x, geometry0.y, geometry0.w, geometry0.h);
   }
 
   ArrangeWindows();
@@ -793,14 +1327,13 @@ void WindowManager::SetFullscreen(Window window, bool fullscreen) {
 
   if (fullscreen) {
     // Save the window's position and size before resizing it to fullscreen.
-    c->workspace()->DisableFocusFollowsMouse();
-    c->set_attr_cache(c->GetXWindowAttributes());
+    c->set_geometry_cache(c->GetGeometry());
     c->workspace()->UnmapAllClients();
   } else {
     // Restore the window's position and size.
-    const XWindowAttributes& attr = c->attr_cache();
+    const Client::Area& geometry = c->geometry_cache();
     c->SetBorderWidth(config_->border_width());
-    c->MoveResize(attr.x, attr.y, attr.width, attr.height);
+    c->MoveResize(geometry.x, geometry.y, geometry.w, geometry.h);
   }
 
   ArrangeWindows();
@@ -836,22 +1369,37 @@ void WindowManager::KillClient(Window window) {
   }
 }
 
-inline void WindowManager::MapDocks() const {
+inline void WindowManager::MapDocks() {
+  if (are_docks_mapped_) {
+    return;
+  }
+
   for (const auto window : docks_) {
     XMapWindow(dpy_, window);
   }
+  are_docks_mapped_ = true;
+  Client::InvalidateStackingOrder();
 }
 
-inline void WindowManager::UnmapDocks() const {
+inline void WindowManager::UnmapDocks() {
+  if (!are_docks_mapped_) {
+    return;
+  }
+
   for (const auto window : docks_) {
     XUnmapWindow(dpy_, window);
   }
+  are_docks_mapped_ = false;
 }
 
 inline void WindowManager::RaiseNotifications() const {
   for (const auto window : notifications_) {
     XRaiseWindow(dpy_, window);
   }
+
+  if (!notifications_.empty()) {
+    Client::InvalidateStackingOrder();
+  }
 }
 
 pair<int, int> WindowManager::GetDisplayResolution() const {
@@ -860,11 +1408,19 @@ pair<int, int> WindowManager::GetDisplayResolution() const {
 }
 
 Client::Area WindowManager::GetTilingArea() const {
-  pair<int, int> res = GetDisplayResolution();
-  Client::Area tiling_area = {0, 0, res.first, res.second};
-
+  // Query the root window and all docks at once.
+  query::WindowAttributesCookie root_window_cookie(root_window_);
+  vector<query::WindowAttributesCookie>& dock_cookies = dock_cookies_;
+  dock_cookies.clear();  // but keep its capacity, so that this doesn't allocate
   for (const auto window : docks_) {
-    XWindowAttributes dock_attr = wm_utils::GetXWindowAttributes(window);
+    dock_cookies.emplace_back(window);
+  }
+
+  const XWindowAttributes& root_window_attr = root_window_cookie.Get();
+  Client::Area tiling_area = {0, 0, root_window_attr.width, root_window_attr.height};
+
+  for (auto& dock_cookie : dock_cookies) {
+    const XWindowAttributes& dock_attr = dock_cookie.Get();
 
     if (dock_attr.y == 0) {
       // If the dock is at the top of the screen.
@@ -900,8 +1456,12 @@ Client::Area WindowManager::GetFloatingWindowArea(Window window, bool use_defaul
   }
 
   // If not using default floating window size, then do the following.
+  // Send all the requests we might need before waiting for any reply.
+  query::WindowAttributesCookie root_window_cookie(root_window_);
+  query::WindowAttributesCookie attr_cookie(window);
+
   Client::Area cookie_area = cookie_.Get(window);
-  XSizeHints hints = wm_utils::GetWmNormalHints(window);
+  const XSizeHints& hints = query::GetWindowInfo(window).normal_hints;
 
   // Determine floating window's x and y.
   if (cookie_area.x > 0 && cookie_area.h > 0) {
@@ -911,10 +1471,10 @@ Client::Area WindowManager::GetFloatingWindowArea(Window window, bool use_defaul
     area.x = hints.x;
     area.y = hints.y;
   } else {
-    pair<int, int> res = GetDisplayResolution();
-    XWindowAttributes attr = wm_utils::GetXWindowAttributes(window);
-    area.x = res.first / 2 - attr.width / 2;
-    area.y = res.second / 2 - attr.height / 2;
+    const XWindowAttributes& root_window_attr = root_window_cookie.Get();
+    const XWindowAttributes& attr = attr_cookie.Get();
+    area.x = root_window_attr.width / 2 - attr.width / 2;
+    area.y = root_window_attr.height / 2 - attr.height / 2;
   }
 
   // Determine floating window's w and h.
@@ -941,41 +1501,50 @@ Client::Area WindowManager::GetFloatingWindowArea(Window window, bool use_defaul
 // Detect where the mouse button was released.
 tuple<Window, AreaType, TilingDirection, TilingPosition> WindowManager::GetDropLocation(
     const XButtonEvent& e) const {
-  Client* c = nullptr;
-  auto it = Client::mapper_.find(e.subwindow);
+  Client* c = Client::mapper_.Find(e.subwindow);
+  Client::Area geometry;
 
-  if (it != Client::mapper_.end()) {
-    c = it->second;
+  if (c) {
+    geometry = c->GetGeometry();
   } else {  // If the point dropped at is not on a window, try to find the window which area
             // contains the point.
     int pad_lt = 1 + config_->gap_width() / 2;
     int pad_rb = pad_lt + 2 * config_->border_width();
-    vector<Client*> clients = workspaces_[current_]->GetClients();
-    auto it = std::find_if(clients.begin(), clients.end(), [&](Client* client) {
-      if (client->is_floating()) {
-        return false;
-      }
 
-      XWindowAttributes attr = client->GetXWindowAttributes();
+    // Query all tiled clients at once, then look for the one containing the point.
+    const ArenaAllocator<Client*> allocator(&event_arena_);
+    ArenaVector<Client*> clients(allocator);
+    for (const auto client : workspaces_[current_]->tiling_clients()) {
+      clients.push_back(client);
+    }
+    ArenaVector<query::WindowAttributesCookie> cookies(allocator);
+    cookies.reserve(clients.size());
+    for (const auto client : clients) {
+      cookies.emplace_back(client->window());
+    }
+
+    for (size_t i = 0; i < clients.size(); i++) {
+      const XWindowAttributes& client_attr = cookies[i].Get();
 
-      return e.x >= attr.x - pad_lt && e.x <= attr.x + attr.width + pad_rb &&
-          e.y >= attr.y - pad_lt && e.y <= attr.y + attr.height + pad_rb;
-    });
+      if (e.x >= client_attr.x - pad_lt && e.x <= client_attr.x + client_attr.width + pad_rb &&
+          e.y >= client_attr.y - pad_lt && e.y <= client_attr.y + client_attr.height + pad_rb) {
+        c = clients[i];
+        geometry = Client::Area(client_attr.x, client_attr.y, client_attr.width,
+                                client_attr.height);
+        break;
+      }
+    }
 
-    if (it != clients.end()) {
-      c = *it;
-    } else {
+    if (!c) {
       return std::make_tuple(None, AreaType::UNDEFINED, TilingDirection::UNSPECIFIED,
                              TilingPosition::AFTER);
     }
   }
 
-  XWindowAttributes attr = c->GetXWindowAttributes();
-
-  int width = attr.width + 2 * config_->border_width();
-  int height = attr.height + 2 * config_->border_width();
-  int x = e.x - attr.x - 0.5 * width;
-  int y = e.y - attr.y - 0.5 * height;
+  int width = geometry.w + 2 * config_->border_width();
+  int height = geometry.h + 2 * config_->border_width();
+  int x = e.x - geometry.x - 0.5 * width;
+  int y = e.y - geometry.y - 0.5 * height;
   double r = x != 0 ? (double)y / x : 0.;
   double r_diagonal = width != 0 ? (double)height / width : 0.;
 
@@ -1008,20 +1577,56 @@ tuple<Window, AreaType, TilingDirection, TilingPosition> WindowManager::GetDropL
   return std::make_tuple(c->window(), area_type, tiling_direction, tiling_position);
 }
 
-void WindowManager::UpdateClientList() {
-  XDeleteProperty(dpy_, root_window_, prop_->net[atom::NET_CLIENT_LIST]);
+void WindowManager::JournalLayoutIfNeeded() {
+  if (!is_layout_dirty_) {
+    return;
+  }
+  is_layout_dirty_ = false;
+  journal_.Record(workspaces_, current_);
+}
 
-  for (const auto& workspace : workspaces_) {
-    for (const auto client : workspace->GetClients()) {
-      Window window = client->window();
-      XChangeProperty(dpy_, root_window_, prop_->net[atom::NET_CLIENT_LIST], XA_WINDOW, 32,
-                      PropModeAppend, reinterpret_cast<unsigned char*>(&window), 1);
-    }
+void WindowManager::UpdateClientListIfNeeded() {
+  if (is_client_list_dirty_) {
+    XChangeProperty(dpy_, root_window_, prop_->net[atom::NET_CLIENT_LIST], XA_WINDOW, 32,
+                    PropModeReplace, reinterpret_cast<unsigned char*>(client_list_.data()),
+                    client_list_.size());
   }
+
+  // Raising a window changes the stacking order, but not the mapping order.
+  if (!is_client_list_dirty_ && published_stacking_order_ == Client::last_stacking_order()) {
+    return;
+  }
+
+  auto stacking_order = [](Window window) {
+    Client* c = Client::mapper_.Find(window);
+    return (c) ? c->stacking_order() : 0UL;
+  };
+
+  client_list_stacking_ = client_list_;
+  std::sort(client_list_stacking_.begin(), client_list_stacking_.end(),
+            [&stacking_order](Window w1, Window w2) {
+              return stacking_order(w1) < stacking_order(w2);
+            });
+
+  XChangeProperty(dpy_, root_window_, prop_->net[atom::NET_CLIENT_LIST_STACKING], XA_WINDOW,
+                  32, PropModeReplace,
+                  reinterpret_cast<unsigned char*>(client_list_stacking_.data()),
+                  client_list_stacking_.size());
+
+  is_client_list_dirty_ = false;
+  published_stacking_order_ = Client::last_stacking_order();
 }
 
 Snapshot& WindowManager::snapshot() {
   return snapshot_;
 }
 
+Journal& WindowManager::journal() {
+  return journal_;
+}
+
+bool WindowManager::is_restarting() const {
+  return is_restarting_;
+}
+
 }  // namespace wmderland
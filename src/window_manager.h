@@ -11,13 +11,18 @@ extern "C" {
 #include <memory>
 #include <tuple>
 #include <unordered_set>
+#include <vector>
 
 #include "action.h"
+#include "arena.h"
 #include "config.h"
 #include "cookie.h"
+#include "event_loop.h"
 #include "ipc.h"
+#include "journal.h"
 #include "mouse.h"
 #include "properties.h"
+#include "query.h"
 #include "snapshot.h"
 #include "util.h"
 #include "workspace.h"
@@ -29,10 +34,14 @@ class WindowManager {
   static WindowManager* GetInstance();
   virtual ~WindowManager();
 
+  void AdoptWindows();
+  void Autostart();
   void Run();
-  void ArrangeWindows() const;
+  void ArrangeWindows();
 
   Snapshot& snapshot();
+  Journal& journal();
+  bool is_restarting() const;
 
  private:
   static bool is_running_;
@@ -43,8 +52,18 @@ class WindowManager {
   void UndoXGrabs();
   void InitProperties();
   void InitWorkspaces();
+  void InitEventLoop();
+
+  // Arrangement is deferred until a batch of XEvents has been handled.
+  void ArrangeWindowsIfNeeded();
+  void ArrangeWindowsNow();
+
+  // EnterNotify events caused by our own requests must not move the focus.
+  void IgnoreEnterNotifySince(unsigned long serial);
+  bool ShouldIgnoreEnterNotify(const XEnterWindowEvent& e) const;
 
   // XEvent handlers
+  void HandleXEvent(const XEvent& event);
   void OnConfigureRequest(const XConfigureRequestEvent& e);
   void OnMapRequest(const XMapRequestEvent& e);
   void OnMapNotify(const XMapEvent& e);
@@ -54,19 +73,29 @@ class WindowManager {
   void OnButtonPress(const XButtonEvent& e);
   void OnButtonRelease(const XButtonEvent& e);
   void OnMotionNotify(const XButtonEvent& e);
+  void OnDragTimerExpired();
+  void DragFloatingClient(const XButtonEvent& e);
   void OnEnterNotify(const XEnterWindowEvent& e);
   void OnClientMessage(const XClientMessageEvent& e);
+  void OnSignal();
+  void OnConfigFileChanged();
+  void ArmLayoutTemplateTimer();
+  void OnLayoutTemplateTimerExpired();
+  void ReloadConfig();
   void OnConfigReload();
   static int OnXError(Display* dpy, XErrorEvent* e);
   static int OnWmDetected(Display* dpy, XErrorEvent* e);
 
-  void Manage(Window window);
+  void Manage(Window window, const Config::WindowRules& rules);
   void Unmanage(Window window);
   void HandleAction(const Action& action);
 
   // Workspace manipulation
   void GotoWorkspace(int next);
 
+  // Focus transition within current workspace
+  void FocusClient(Window window);
+
   // Window replacement
   void MoveWindowToWorkspace(Window window, int next);
   void MoveWindow(Window window, Window ref, AreaType area_type,
@@ -79,8 +108,8 @@ class WindowManager {
   void KillClient(Window window);
 
   // Docks, bars and notifications
-  inline void MapDocks() const;
-  inline void UnmapDocks() const;
+  inline void MapDocks();
+  inline void UnmapDocks();
   inline void RaiseNotifications() const;
 
   // Window position and size
@@ -90,9 +119,13 @@ class WindowManager {
   std::tuple<Window, AreaType, TilingDirection, TilingPosition> GetDropLocation(
       const XButtonEvent& e) const;
 
-  // Misc
-  void UpdateClientList();
+  // _NET_CLIENT_LIST and _NET_CLIENT_LIST_STACKING are written at most once
+  // per batch of XEvents, and only if they have changed.
+  void UpdateClientListIfNeeded();
 
+  // The layout is journaled at most once per batch of XEvents, and only if
+  // a handler may have changed it (see Journal).
+  void JournalLayoutIfNeeded();
 
   Display* dpy_;
   Window root_window_;
@@ -104,11 +137,14 @@ class WindowManager {
   Cookie cookie_;                     // remembers pos/size of each window
   IpcEventManager ipc_evmgr_;         // client event manager
   Snapshot snapshot_;                 // error recovery
+  Journal journal_;                   // crash recovery
 
   // The floating windows unordered_set contains windows that should not be
   // tiled but must be kept on the top, e.g., dock, notifications, etc.
   std::unordered_set<Window> docks_;
   std::unordered_set<Window> notifications_;
+  bool are_docks_mapped_;
+  mutable std::vector<query::WindowAttributesCookie> dock_cookies_;  // see GetTilingArea()
 
   // Some programs (e.g., WPS office, Steam) might unmap its window(s)
   // but keep them in the background instead of destroying them. It is
@@ -122,8 +158,55 @@ class WindowManager {
   std::array<std::unique_ptr<Workspace>, WORKSPACE_COUNT> workspaces_;
   int current_;  // current workspace
 
+  // Handlers only mark current workspace as dirty by calling ArrangeWindows().
+  // The windows are actually arranged at most once per batch of XEvents.
+  static const int kMaxEventBatchSize_;
+  bool needs_arrange_;
+  unsigned long arrange_request_count_;
+  unsigned long arrange_count_;
+  unsigned long arrange_allocation_count_;  // only counted with COUNT_ALLOCATIONS
+
+  // The temporary containers made while handling a batch of events are
+  // allocated from event_arena_, which is reset once the batch is done.
+  mutable Arena event_arena_;
+  std::array<unsigned long, LASTEvent> event_counts_;
+  std::array<unsigned long, LASTEvent> event_allocation_counts_;  // see above
+
+  // An EnterNotify event carries the serial of the last request processed by
+  // the X server when it was generated, so the ones caused by rearranging the
+  // windows can be told apart from those caused by the user moving the pointer.
+  // These are the serial ranges of the most recent rearrangements.
+  static const int kIgnoredSerialRangeCount_ = 8;
+  std::array<std::pair<unsigned long, unsigned long>, kIgnoredSerialRangeCount_>
+      ignored_serial_ranges_;
+  int ignored_serial_ranges_head_;
+  unsigned long arrange_begin_serial_;
+
+  // The managed windows in order of mapping (_NET_CLIENT_LIST). The stacking
+  // order (_NET_CLIENT_LIST_STACKING) is derived from it by sorting the windows
+  // by Client::stacking_order().
+  std::vector<Window> client_list_;
+  std::vector<Window> client_list_stacking_;
+  bool is_client_list_dirty_;
+  unsigned long published_stacking_order_;
+
+  bool is_layout_dirty_;
+
+  // Set by the restart action, so that main() hands the state over to a new
+  // process once Run() has returned (see Snapshot::SaveToMemfd()).
+  bool is_restarting_;
+
+  // The main loop sleeps in event_loop_, which wakes up on X events as well as
+  // the drag timer, signals (SIGCHLD, SIGTERM, SIGHUP) and config file changes.
+  EventLoop event_loop_;
+  int signal_fd_;
+  int inotify_fd_;
+  int layout_template_timer_fd_;  // see ArmLayoutTemplateTimer()
+
   friend class IpcEventManager;
   friend class Snapshot;
+  friend class Journal;
+  friend class Bench;  // see bench/bench.cc
 };
 
 }  // namespace wmderland
@@ -0,0 +1,155 @@
+// Copyright (c) 2018-2020 Marco Wang <m.aesophor@gmail.com>
+#ifndef WMDERLAND_WINDOW_MAP_H_
+#define WMDERLAND_WINDOW_MAP_H_
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace wmderland {
+
+// An open addressing (linear probing) hash table which maps Window (XID) to T*.
+//
+// The entries are stored in a single array which is kept at most half full,
+// so a lookup usually costs one probe into one cache line. Erasing an entry
+// shifts the following entries of its cluster backward instead of leaving a
+// tombstone, so nothing is allocated or freed unless the table has to grow.
+template <typename T>
+class WindowMap {
+ public:
+  using Entry = std::pair<Window, T*>;  // first == None if the slot is empty
+
+  class Iterator {
+   public:
+    Iterator(const Entry* entry, const Entry* end) : entry_(entry), end_(end) {
+      SkipEmptySlots();
+    }
+
+    const Entry& operator*() const {
+      return *entry_;
+    }
+
+    Iterator& operator++() {
+      ++entry_;
+      SkipEmptySlots();
+      return *this;
+    }
+
+    bool operator!=(const Iterator& other) const {
+      return entry_ != other.entry_;
+    }
+
+   private:
+    void SkipEmptySlots() {
+      while (entry_ != end_ && entry_->first == None) {
+        ++entry_;
+      }
+    }
+
+    const Entry* entry_;
+    const Entry* end_;
+  };
+
+  WindowMap() : entries_(kInitialCapacity_, Entry(None, nullptr)), size_() {}
+  virtual ~WindowMap() = default;
+
+  T* Find(Window window) const {
+    for (size_t i = GetSlot(window);; i = (i + 1) & mask()) {
+      if (entries_[i].first == window) {
+        return entries_[i].second;
+      } else if (entries_[i].first == None) {
+        return nullptr;
+      }
+    }
+  }
+
+  void Insert(Window window, T* value) {
+    if ((size_ + 1) * 2 > entries_.size()) {
+      Rehash(entries_.size() * 2);
+    }
+
+    size_t i = GetSlot(window);
+    while (entries_[i].first != None && entries_[i].first != window) {
+      i = (i + 1) & mask();
+    }
+
+    if (entries_[i].first == None) {
+      size_++;
+    }
+    entries_[i] = Entry(window, value);
+  }
+
+  void Erase(Window window) {
+    size_t i = GetSlot(window);
+    while (entries_[i].first != window) {
+      if (entries_[i].first == None) {
+        return;
+      }
+      i = (i + 1) & mask();
+    }
+
+    // Move each of the following entries of this cluster into the hole,
+    // unless the slot it hashes to lies (cyclically) after the hole.
+    for (size_t j = (i + 1) & mask(); entries_[j].first != None; j = (j + 1) & mask()) {
+      const size_t slot = GetSlot(entries_[j].first);
+      if (((j - slot) & mask()) >= ((j - i) & mask())) {
+        entries_[i] = entries_[j];
+        i = j;
+      }
+    }
+
+    entries_[i] = Entry(None, nullptr);
+    size_--;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  Iterator begin() const {
+    return Iterator(entries_.data(), entries_.data() + entries_.size());
+  }
+
+  Iterator end() const {
+    return Iterator(entries_.data() + entries_.size(), entries_.data() + entries_.size());
+  }
+
+ private:
+  static const size_t kInitialCapacity_ = 64;  // must be a power of 2
+
+  // XIDs allocated by the same X client only differ in their lowest bits,
+  // so they are scattered with Fibonacci hashing.
+  size_t GetSlot(Window window) const {
+    return (static_cast<uint64_t>(window) * 0x9e3779b97f4a7c15ULL) >> (64 - capacity_bits());
+  }
+
+  size_t mask() const {
+    return entries_.size() - 1;
+  }
+
+  int capacity_bits() const {
+    return __builtin_ctzll(entries_.size());
+  }
+
+  void Rehash(size_t capacity) {
+    std::vector<Entry> entries(capacity, Entry(None, nullptr));
+    entries_.swap(entries);
+    size_ = 0;
+
+    for (const auto& entry : entries) {
+      if (entry.first != None) {
+        Insert(entry.first, entry.second);
+      }
+    }
+  }
+
+  std::vector<Entry> entries_;
+  size_t size_;
+};
+
+}  // namespace wmderland
+
+#endif  // WMDERLAND_WINDOW_MAP_H_
@@ -5,8 +5,8 @@
 #include <stack>
 
 #include "client.h"
+#include "query.h"
 #include "util.h"
-#include "window_manager.h"
 
 using std::stack;
 using std::string;
@@ -15,8 +15,6 @@ using std::vector;
 
 namespace wmderland {
 
-class WindowManager;
-
 Workspace::Workspace(Display* dpy, Window root_window, Config* config, int id)
     : dpy_(dpy),
       root_window_(root_window),
@@ -24,7 +22,10 @@ Workspace::Workspace(Display* dpy, Window root_window, Config* config, int id)
       client_tree_(),
       id_(id),
       name_(std::to_string(id)),
-      is_fullscreen_() {}
+      is_fullscreen_(),
+      layout_template_(),
+      template_nodes_(),
+      free_slot_count_() {}
 
 bool Workspace::Has(Window window) const {
   return GetClient(window) != nullptr;
@@ -32,22 +33,45 @@ bool Workspace::Has(Window window) const {
 
 void Workspace::Add(Window window, TilingPosition tiling_position) {
   unique_ptr<Client> client = std::make_unique<Client>(dpy_, window, this);
-  unique_ptr<Tree::Node> new_node = std::make_unique<Tree::Node>(std::move(client));
+  AttachNode(client_tree_.NewNode(std::move(client)), tiling_position);
+}
 
-  Tree::Node* new_node_raw = new_node.get();
+// Only an empty workspace can take a template.
+void Workspace::ApplyLayoutTemplate(const LayoutTemplate& layout_template) {
+  if (!client_tree_.root_node()->children().empty() || layout_template.empty()) {
+    return;
+  }
 
-  // If there are no windows at all, then add this new node as the root's child.
-  // Otherwise, add this new node as current node's sibling.
-  if (!client_tree_.current_node()) {
-    client_tree_.root_node()->AddChild(std::move(new_node));
-  } else {
-    Tree::Node* current_node = client_tree_.current_node();
-    current_node->parent()->InsertChildBeside(std::move(new_node), current_node,
-                                              tiling_position);
+  layout_template_ = layout_template;
+  template_nodes_.assign(layout_template_.nodes().size(), nullptr);
+  template_nodes_[0] = client_tree_.root_node();
+  template_nodes_[0]->set_tiling_direction(layout_template_.nodes()[0].tiling_direction);
+  free_slot_count_ = layout_template_.slot_count();
+}
+
+bool Workspace::HasFreeSlot(const query::WindowInfo& info) const {
+  return FindFreeSlot(info) != -1;
+}
+
+void Workspace::AddToSlot(Window window, const query::WindowInfo& info) {
+  const int slot = FindFreeSlot(info);
+  if (slot == -1) {
+    Add(window);
+    return;
   }
 
+  unique_ptr<Client> client = std::make_unique<Client>(dpy_, window, this);
+  Tree::NodePtr node = client_tree_.NewNode(std::move(client));
+  Tree::Node* node_raw = node.get();
+  InsertTemplateNode(slot, std::move(node));
+
   if (!is_fullscreen_) {
-    client_tree_.set_current_node(new_node_raw);
+    client_tree_.set_current_node(node_raw);
+  }
+
+  // The tree has been built exactly as the template, so it tiles the same.
+  if (--free_slot_count_ == 0) {
+    DropLayoutTemplate();
   }
 }
 
@@ -57,18 +81,59 @@ void Workspace::Remove(Window window) {
     return;
   }
 
-  Tree::Node* node = client_tree_.GetTreeNode(c);
-  if (!node) {
-    return;
+  // The detached node is freed along with its client.
+  DetachNode(c->node());
+}
+
+// Takes an existing client out of this workspace without destroying it,
+// so that it can be attached to another workspace.
+unique_ptr<Client> Workspace::Detach(Window window) {
+  Client* c = GetClient(window);
+  if (!c) {
+    return nullptr;
   }
 
-  // Get leaves and find the index of the node we're going to remove.
-  vector<Tree::Node*> nodes = client_tree_.GetLeaves();
-  ptrdiff_t idx = find(nodes.begin(), nodes.end(), node) - nodes.begin();
+  Tree::NodePtr node = DetachNode(c->node());
+  return unique_ptr<Client>(node->release_client());
+}
+
+// Adds a client which has been detached from another workspace. The client
+// (and its server-side state) is kept as is, so nothing is sent to the X server.
+void Workspace::Attach(unique_ptr<Client> client, TilingPosition tiling_position) {
+  client->set_workspace(this);
+  AttachNode(client_tree_.NewNode(std::move(client)), tiling_position);
+}
+
+void Workspace::AttachNode(Tree::NodePtr node, TilingPosition tiling_position) {
+  Tree::Node* node_raw = node.get();
+  DropLayoutTemplate();
+
+  // If there are no windows at all, then add this new node as the root's child.
+  // Otherwise, add this new node as current node's sibling.
+  if (!client_tree_.current_node()) {
+    client_tree_.root_node()->AddChild(std::move(node));
+  } else {
+    Tree::Node* current_node = client_tree_.current_node();
+    current_node->parent()->InsertChildBeside(std::move(node), current_node,
+                                              tiling_position);
+  }
+
+  if (!is_fullscreen_) {
+    client_tree_.set_current_node(node_raw);
+  }
+}
+
+Tree::NodePtr Workspace::DetachNode(Tree::Node* node) {
+  DropLayoutTemplate();
+
+  // The leaf after the one we're going to remove (or the one before it if
+  // there's none) will be the new current Tree::Node. If there are no windows
+  // left, it will be nullptr.
+  Tree::Node* new_current_node = (node->next_leaf()) ? node->next_leaf() : node->prev_leaf();
 
   // Remove this node from its parent.
   Tree::Node* parent_node = node->parent();
-  parent_node->RemoveChild(node);
+  Tree::NodePtr detached_node = parent_node->RemoveChild(node);
 
   // If its parent has no children left, then remove parent from its grandparent
   // (If this parent is not the root).
@@ -78,20 +143,8 @@ void Workspace::Remove(Window window) {
     parent_node = grandparent_node;
   }
 
-  // Decide which node shall be set as the new current Tree::Node. If there are
-  // no windows left, set current to nullptr.
-  nodes.erase(std::remove(nodes.begin(), nodes.end(), node), nodes.end());
-
-  if (nodes.empty()) {
-    client_tree_.set_current_node(nullptr);
-    return;
-  }
-
-  // If idx is out of bound, decrement it by one.
-  if (idx >= static_cast<ptrdiff_t>(nodes.size())) {
-    idx--;
-  }
-  client_tree_.set_current_node(nodes[idx]);
+  client_tree_.set_current_node(new_current_node);
+  return detached_node;
 }
 
 // The tree with redundant internal nodes looks the same as the tree without them though they
@@ -108,20 +161,9 @@ void Workspace::Move(Window window, Workspace* new_workspace) {
     return;
   }
 
-  bool is_floating = c->is_floating();
-  bool has_unmap_req_from_wm = c->has_unmap_req_from_wm();
-
-  // This will delete current Client* c, and erase it from Client::mapper_
-  this->Remove(window);
-
-  // This will allocate a new Client* c', and insert it into Client::mapper_
-  new_workspace->Add(window);
-
-  // Transfer old client's state to the new client.
-  c = new_workspace->GetClient(window);
-  c->set_floating(is_floating);
+  // The same Client* c is relinked into the new workspace's tree.
   c->set_fullscreen(false);
-  c->set_has_unmap_req_from_wm(has_unmap_req_from_wm);
+  new_workspace->Attach(Detach(window));
 
   client_tree_.Normalize();
 }
@@ -190,13 +232,9 @@ void Workspace::MoveAndSplit(Window window, Window ref, TilingDirection tiling_d
     return;
   }
 
-  bool is_floating = c->is_floating();
-  bool is_mapped = c->is_mapped();
-  bool has_unmap_req_from_wm = c->has_unmap_req_from_wm();
+  Tree::NodePtr node = DetachNode(c->node());
 
-  Remove(window);
-
-  unique_ptr<Tree::Node> new_node = std::make_unique<Tree::Node>(nullptr);
+  Tree::NodePtr new_node = client_tree_.NewNode();
   Tree::Node* new_node_raw = new_node.get();
   Tree::Node* original_parent_node = ref_node->parent();
 
@@ -216,14 +254,8 @@ void Workspace::MoveAndSplit(Window window, Window ref, TilingDirection tiling_d
     new_node_raw->set_tiling_direction(tiling_direction);
   }
 
-  Add(window, tiling_position);
-
-  // Transfer old client's state to the new client.
-  c = ref_client->workspace()->GetClient(window);
-  c->set_floating(is_floating);
   c->set_fullscreen(false);
-  c->set_mapped(is_mapped);
-  c->set_has_unmap_req_from_wm(has_unmap_req_from_wm);
+  AttachNode(std::move(node), tiling_position);
 }
 
 void Workspace::MoveAndInsert(Window window, Window ref, TilingPosition tiling_position,
@@ -250,21 +282,11 @@ void Workspace::MoveAndInsert(Window window, Window ref, TilingPosition tiling_p
     return;
   }
 
-  bool is_floating = c->is_floating();
-  bool is_mapped = c->is_mapped();
-  bool has_unmap_req_from_wm = c->has_unmap_req_from_wm();
+  Tree::NodePtr node = DetachNode(c->node());
 
-  Remove(window);
-
-  client_tree_.set_current_node(ref_node);
-  Add(window, tiling_position);
-
-  // Transfer old client's state to the new client.
-  c = ref_client->workspace()->GetClient(window);
-  c->set_floating(is_floating);
   c->set_fullscreen(false);
-  c->set_mapped(is_mapped);
-  c->set_has_unmap_req_from_wm(has_unmap_req_from_wm);
+  client_tree_.set_current_node(ref_node);
+  AttachNode(std::move(node), tiling_position);
 }
 
 void Workspace::Swap(Window window0, Window window1) {
@@ -299,7 +321,8 @@ void Workspace::Swap(Window window0, Window window1) {
 void Workspace::Tile(const Client::Area& tiling_area) const {
   // If there are no clients in this workspace or all clients are floating,
   // return at once.
-  if (!client_tree_.current_node() || GetTilingClients().empty()) {
+  if (!client_tree_.current_node() ||
+      !client_tree_.root_node()->HasTilingClientsInSubtree()) {
     return;
   }
 
@@ -311,28 +334,28 @@ void Workspace::Tile(const Client::Area& tiling_area) const {
   int w = tiling_area.w - gap_width;
   int h = tiling_area.h - gap_width;
 
-  DfsTileHelper(client_tree_.root_node(), x, y, w, h, border_width, gap_width);
+  if (!layout_template_.empty()) {
+    DfsTileTemplateHelper(0, x, y, w, h, border_width, gap_width);
+  } else {
+    DfsTileHelper(client_tree_.root_node(), x, y, w, h, border_width, gap_width);
+  }
 }
 
 void Workspace::DfsTileHelper(Tree::Node* node, int x, int y, int w, int h, int border_width,
                               int gap_width) const {
-  vector<Tree::Node*> children = node->children();
-
   // We don't care about two kinds of `Tree::Node`s
   // 1. an internal node with no tiling clients in its subtree
   // 2. a leaf but it has a floating client
   // Tree::Node::HasTilingClientsInSubtree() can check 1 and 2 at the same time.
-  children.erase(std::remove_if(children.begin(), children.end(),
-                                [](Tree::Node* n) { return !n->HasTilingClientsInSubtree(); }),
-                 children.end());
-
-  if (children.empty()) {
-    return;
+  double total_ratio = 0.;
+  for (const auto child : node->children()) {
+    if (child->HasTilingClientsInSubtree()) {
+      total_ratio += child->ratio();
+    }
   }
 
-  double total_ratio = 0.;
-  for (const auto& child : children) {
-    total_ratio += child->ratio();
+  if (total_ratio == 0.) {
+    return;
   }
 
   // Calculate each child's x, y, width and height based on node's tiling
@@ -341,8 +364,11 @@ void Workspace::DfsTileHelper(Tree::Node* node, int x, int y, int w, int h, int
   int child_x = x;
   int child_y = y;
 
-  for (size_t i = 0; i < children.size(); i++) {
-    Tree::Node* child = children[i];
+  for (const auto child : node->children()) {
+    if (!child->HasTilingClientsInSubtree()) {
+      continue;
+    }
+
     int child_width =
         (dir == TilingDirection::HORIZONTAL) ? w * child->ratio() / total_ratio : w;
     int child_height =
@@ -364,6 +390,105 @@ void Workspace::DfsTileHelper(Tree::Node* node, int x, int y, int w, int h, int
   }
 }
 
+// Same as DfsTileHelper(), except that the empty slots of the template take up
+// their space as well. Once all the slots are filled, both of them result in
+// exactly the same geometry.
+void Workspace::DfsTileTemplateHelper(int index, int x, int y, int w, int h, int border_width,
+                                      int gap_width) const {
+  const vector<LayoutTemplate::Node>& nodes = layout_template_.nodes();
+  const LayoutTemplate::Node& node = nodes[index];
+
+  double total_ratio = 0.;
+  for (const auto child : node.children) {
+    total_ratio += nodes[child].ratio;
+  }
+
+  TilingDirection dir = node.tiling_direction;
+  int child_x = x;
+  int child_y = y;
+
+  for (const auto child : node.children) {
+    int child_width =
+        (dir == TilingDirection::HORIZONTAL) ? w * nodes[child].ratio / total_ratio : w;
+    int child_height =
+        (dir == TilingDirection::VERTICAL) ? h * nodes[child].ratio / total_ratio : h;
+
+    if (nodes[child].children.empty()) {
+      Tree::Node* leaf = template_nodes_[child];
+      if (leaf && leaf->HasTilingClientsInSubtree()) {
+        int new_x = child_x + gap_width / 2;
+        int new_y = child_y + gap_width / 2;
+        int new_width = child_width - border_width * 2 - gap_width;
+        int new_height = child_height - border_width * 2 - gap_width;
+        leaf->client()->MoveResize(new_x, new_y, new_width, new_height);
+      }
+    } else {
+      DfsTileTemplateHelper(child, child_x, child_y, child_width, child_height, border_width,
+                            gap_width);
+    }
+
+    if (dir == TilingDirection::HORIZONTAL) child_x += child_width;
+    if (dir == TilingDirection::VERTICAL) child_y += child_height;
+  }
+}
+
+// Returns the first free slot which `info` matches, or -1 if there's none.
+int Workspace::FindFreeSlot(const query::WindowInfo& info) const {
+  for (size_t i = 0; i < template_nodes_.size(); i++) {
+    if (!template_nodes_[i] && layout_template_.Matches(i, info)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Inserts `node` as the tree node of the template node `index` (and its
+// ancestors if they haven't been inserted yet) among the siblings which
+// have been inserted, in the order of the template.
+void Workspace::InsertTemplateNode(int index, Tree::NodePtr node) {
+  const vector<LayoutTemplate::Node>& nodes = layout_template_.nodes();
+  const int parent_index = nodes[index].parent;
+  template_nodes_[index] = node.get();
+
+  if (!template_nodes_[parent_index]) {
+    Tree::NodePtr parent = client_tree_.NewNode();
+    parent->set_tiling_direction(nodes[parent_index].tiling_direction);
+    InsertTemplateNode(parent_index, std::move(parent));
+  }
+
+  Tree::Node* parent = template_nodes_[parent_index];
+  Tree::Node* prev_sibling = nullptr;
+  for (const auto sibling : nodes[parent_index].children) {
+    if (sibling == index) {
+      break;
+    } else if (template_nodes_[sibling]) {
+      prev_sibling = template_nodes_[sibling];
+    }
+  }
+
+  if (prev_sibling) {
+    parent->InsertChildAfter(std::move(node), prev_sibling);
+  } else if (!parent->children().empty()) {
+    parent->InsertChildBeside(std::move(node), parent->children().front(),
+                              TilingPosition::BEFORE);
+  } else {
+    parent->AddChild(std::move(node));
+  }
+
+  // Inserting a child has changed the ratios of its siblings.
+  for (const auto sibling : nodes[parent_index].children) {
+    if (template_nodes_[sibling]) {
+      template_nodes_[sibling]->set_ratio(nodes[sibling].ratio);
+    }
+  }
+}
+
+void Workspace::DropLayoutTemplate() {
+  layout_template_.Clear();
+  template_nodes_.clear();
+  free_slot_count_ = 0;
+}
+
 void Workspace::SetTilingDirection(TilingDirection tiling_direction) {
   if (!client_tree_.current_node()) {
     client_tree_.root_node()->set_tiling_direction(tiling_direction);
@@ -380,7 +505,7 @@ void Workspace::SetTilingDirection(TilingDirection tiling_direction) {
   }
 
   unique_ptr<Client> client(current_node->release_client());
-  unique_ptr<Tree::Node> new_node = std::make_unique<Tree::Node>(std::move(client));
+  Tree::NodePtr new_node = client_tree_.NewNode(std::move(client));
 
   // If the user has specified a tiling direction on current node, then
   // 1. Let current node become an internal node.
@@ -392,13 +517,13 @@ void Workspace::SetTilingDirection(TilingDirection tiling_direction) {
 }
 
 void Workspace::MapAllClients() const {
-  for (const auto c : GetClients()) {
+  for (const auto c : clients()) {
     c->Map();
   }
 }
 
 void Workspace::UnmapAllClients(Window except_window) const {
-  for (const auto c : GetClients()) {
+  for (const auto c : clients()) {
     if (c->window() != except_window) {
       c->Unmap();
     }
@@ -406,7 +531,7 @@ void Workspace::UnmapAllClients(Window except_window) const {
 }
 
 void Workspace::RaiseAllFloatingClients() const {
-  for (const auto c : GetFloatingClients()) {
+  for (const auto c : floating_clients()) {
     c->Raise();
   }
 }
@@ -417,8 +542,11 @@ void Workspace::SetFocusedClient(Window window) {
     return;
   }
 
-  // Raise the window to the top and set input focus to it.
-  c->Raise();
+  // Tiled clients never overlap each other, so only floating (or fullscreen)
+  // clients have to be raised to the top. Then set input focus to it.
+  if (c->is_floating() || c->is_fullscreen()) {
+    c->Raise();
+  }
   c->SetInputFocus();
   c->SetBorderColor(config_->focused_color());
   client_tree_.set_current_node(client_tree_.GetTreeNode(c));
@@ -435,26 +563,6 @@ void Workspace::UnsetFocusedClient() const {
   }
 }
 
-void Workspace::DisableFocusFollowsMouse() const {
-  if (!config_->focus_follows_mouse()) {
-    return;
-  }
-
-  for (const auto c : GetClients()) {
-    c->SelectInput(None);
-  }
-}
-
-void Workspace::EnableFocusFollowsMouse() const {
-  if (!config_->focus_follows_mouse()) {
-    return;
-  }
-
-  for (const auto c : GetClients()) {
-    c->SelectInput(EnterWindowMask);
-  }
-}
-
 void Workspace::ResizeTiled(Action::Type resize_action_type, int deltaPercentage) {
   if (!client_tree_.current_node() || !client_tree_.current_node()->parent() ||
       this->is_fullscreen()) {
@@ -492,12 +600,14 @@ void Workspace::ResizeDistributeRatios() {
   client_tree_.current_node()->parent()->DistributeChildrenRatios();
 }
 
-void Workspace::Navigate(Action::Type focus_action_type) {
+// Returns the client which is next to the focused client in the specified
+// direction, or nullptr if there isn't one. Focusing it is up to the caller.
+Client* Workspace::Navigate(Action::Type focus_action_type) const {
   // Do not let user navigate between windows if
   // 1. there's no currently focused client
   // 2. current workspace is in fullscreen mode (there's a fullscreen window)
   if (!client_tree_.current_node() || this->is_fullscreen()) {
-    return;
+    return nullptr;
   }
 
   TilingDirection target_direction = TilingDirection::HORIZONTAL;
@@ -521,7 +631,7 @@ void Workspace::Navigate(Action::Type focus_action_type) {
       find_leftward = false;
       break;
     default:
-      return;
+      return nullptr;
   }
 
   for (Tree::Node* node = client_tree_.current_node(); node; node = node->parent()) {
@@ -532,14 +642,12 @@ void Workspace::Navigate(Action::Type focus_action_type) {
       while (!node->leaf()) {
         node = (find_leftward) ? node->children().back() : node->children().front();
       }
-      UnsetFocusedClient();
-      SetFocusedClient(node->client()->window());
-      WindowManager::GetInstance()->ArrangeWindows();
-      return;
+      return node->client();
     } else if (node->parent() == client_tree_.root_node()) {
-      return;
+      return nullptr;
     }
   }
+  return nullptr;
 }
 
 Client* Workspace::GetFocusedClient() const {
@@ -552,41 +660,22 @@ Client* Workspace::GetFocusedClient() const {
 Client* Workspace::GetClient(Window window) const {
   // We'll get the corresponding client using client mapper
   // whose time complexity is O(1).
-  auto it = Client::mapper_.find(window);
-  if (it == Client::mapper_.end()) {
-    return nullptr;
-  }
+  Client* c = Client::mapper_.Find(window);
 
   // But we have to check if it belongs to current workspace!
-  Client* c = it->second;
-  return (c->workspace() == this) ? c : nullptr;
+  return (c && c->workspace() == this) ? c : nullptr;
 }
 
-vector<Client*> Workspace::GetClients() const {
-  vector<Client*> clients;
-
-  for (auto leaf : client_tree_.GetLeaves()) {
-    if (leaf != client_tree_.root_node()) {
-      clients.push_back(leaf->client());
-    }
-  }
-  return clients;
+Workspace::ClientView Workspace::clients() const {
+  return ClientView(client_tree_.root_node()->GetFirstLeaf(), ClientView::Filter::ALL);
 }
 
-vector<Client*> Workspace::GetFloatingClients() const {
-  vector<Client*> clients = GetClients();
-  clients.erase(std::remove_if(clients.begin(), clients.end(),
-                               [](Client* c) { return !c->is_floating(); }),
-                clients.end());
-  return clients;
+Workspace::ClientView Workspace::floating_clients() const {
+  return ClientView(client_tree_.root_node()->GetFirstLeaf(), ClientView::Filter::FLOATING);
 }
 
-vector<Client*> Workspace::GetTilingClients() const {
-  vector<Client*> clients = GetClients();
-  clients.erase(std::remove_if(clients.begin(), clients.end(),
-                               [](Client* c) { return c->is_floating(); }),
-                clients.end());
-  return clients;
+Workspace::ClientView Workspace::tiling_clients() const {
+  return ClientView(client_tree_.root_node()->GetFirstLeaf(), ClientView::Filter::TILING);
 }
 
 Config* Workspace::config() const {
@@ -613,12 +702,59 @@ void Workspace::set_fullscreen(bool fullscreen) {
   is_fullscreen_ = fullscreen;
 }
 
-string Workspace::Serialize() const {
-  return client_tree_.Serialize();
+void Workspace::Serialize(SnapshotWriter* writer) const {
+  client_tree_.Serialize(writer);
+}
+
+void Workspace::Deserialize(SnapshotReader* reader) {
+  client_tree_.Deserialize(reader);
 }
 
-void Workspace::Deserialize(string data) {
-  client_tree_.Deserialize(data);
+Workspace::ClientView::ClientView(Tree::Node* first_leaf, Filter filter)
+    : first_leaf_(first_leaf), filter_(filter) {}
+
+Workspace::ClientView::Iterator Workspace::ClientView::begin() const {
+  return Iterator(first_leaf_, filter_);
+}
+
+Workspace::ClientView::Iterator Workspace::ClientView::end() const {
+  return Iterator(nullptr, filter_);
+}
+
+bool Workspace::ClientView::empty() const {
+  return !(begin() != end());
+}
+
+Workspace::ClientView::Iterator::Iterator(Tree::Node* leaf, Filter filter)
+    : leaf_(leaf), filter_(filter) {
+  SkipFilteredLeaves();
+}
+
+Client* Workspace::ClientView::Iterator::operator*() const {
+  return leaf_->client();
+}
+
+Workspace::ClientView::Iterator& Workspace::ClientView::Iterator::operator++() {
+  leaf_ = leaf_->next_leaf();
+  SkipFilteredLeaves();
+  return *this;
+}
+
+bool Workspace::ClientView::Iterator::operator!=(const Iterator& other) const {
+  return leaf_ != other.leaf_;
+}
+
+// A leaf holds a tiling or a floating client (which is reflected by its leaf
+// counts), or no client at all if it's the root of an empty tree.
+void Workspace::ClientView::Iterator::SkipFilteredLeaves() {
+  while (leaf_) {
+    if ((filter_ == ALL && leaf_->leaf_count() > 0) ||
+        (filter_ == FLOATING && leaf_->floating_leaf_count() > 0) ||
+        (filter_ == TILING && leaf_->tiling_leaf_count() > 0)) {
+      return;
+    }
+    leaf_ = leaf_->next_leaf();
+  }
 }
 
 }  // namespace wmderland
@@ -5,11 +5,13 @@
 extern "C" {
 #include <X11/Xlib.h>
 }
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "client.h"
 #include "config.h"
+#include "layout_template.h"
 #include "tree.h"
 
 namespace wmderland {
@@ -23,12 +25,65 @@ enum class AreaType {
 
 class Workspace {
  public:
+  // A view of the clients of a workspace (optionally only the floating or the
+  // tiling ones) in the order of the leaves of its client tree. Iterating over
+  // it doesn't allocate anything, and the floating/tiling filters are checked
+  // against the tree nodes without touching the clients that they skip. It is
+  // invalidated as soon as a client is added to or removed from the workspace.
+  class ClientView {
+   public:
+    enum Filter {
+      ALL,
+      FLOATING,
+      TILING,
+    };
+
+    class Iterator {
+     public:
+      Iterator(Tree::Node* leaf, Filter filter);
+      Client* operator*() const;
+      Iterator& operator++();
+      bool operator!=(const Iterator& other) const;
+
+     private:
+      void SkipFilteredLeaves();
+
+      Tree::Node* leaf_;
+      Filter filter_;
+    };
+
+    ClientView(Tree::Node* first_leaf, Filter filter);
+
+    Iterator begin() const;
+    Iterator end() const;
+    bool empty() const;
+
+   private:
+    Tree::Node* first_leaf_;
+    Filter filter_;
+  };
+
   Workspace(Display* dpy, Window root_window_, Config* config, int id);
   virtual ~Workspace() = default;
 
   bool Has(Window window) const;
   void Add(Window window, TilingPosition tiling_position = TilingPosition::AFTER);
+
+  // Layout templates (see LayoutTemplate). Once a template has been applied to
+  // an empty workspace, the windows which match its slots are added right into
+  // them, and the workspace is tiled as if all the slots were occupied. The
+  // template is dropped when all its slots are filled, or as soon as any other
+  // client is attached to or detached from the workspace. The WM drops all the
+  // templates once the startup is over, see WindowManager::ArmLayoutTemplateTimer().
+  void ApplyLayoutTemplate(const LayoutTemplate& layout_template);
+  bool HasFreeSlot(const query::WindowInfo& info) const;
+  void AddToSlot(Window window, const query::WindowInfo& info);
+  void DropLayoutTemplate();
+
   void Remove(Window window);
+  std::unique_ptr<Client> Detach(Window window);
+  void Attach(std::unique_ptr<Client> client,
+              TilingPosition tiling_position = TilingPosition::AFTER);
   void Normalize();
   void Move(Window window, Workspace* new_workspace);
   void Move(Window window, Window ref, AreaType area_type, TilingDirection tiling_direction,
@@ -50,15 +105,12 @@ class Workspace {
   void SetFocusedClient(Window window);
   void UnsetFocusedClient() const;
 
-  void DisableFocusFollowsMouse() const;
-  void EnableFocusFollowsMouse() const;
-
-  void Navigate(Action::Type navigate_action_type);
+  Client* Navigate(Action::Type navigate_action_type) const;
   Client* GetFocusedClient() const;
   Client* GetClient(Window window) const;
-  std::vector<Client*> GetClients() const;
-  std::vector<Client*> GetFloatingClients() const;
-  std::vector<Client*> GetTilingClients() const;
+  Workspace::ClientView clients() const;
+  Workspace::ClientView floating_clients() const;
+  Workspace::ClientView tiling_clients() const;
 
   Config* config() const;
   int id() const;
@@ -68,13 +120,20 @@ class Workspace {
   void set_name(const std::string& name);
   void set_fullscreen(bool fullscreen);
 
-  std::string Serialize() const;
-  void Deserialize(std::string data);
+  void Serialize(SnapshotWriter* writer) const;
+  void Deserialize(SnapshotReader* reader);
 
  private:
+  void AttachNode(Tree::NodePtr node, TilingPosition tiling_position);
+  Tree::NodePtr DetachNode(Tree::Node* node);
   void DfsTileHelper(Tree::Node* node, int x, int y, int w, int h, int border_width,
                      int gap_width) const;
 
+  int FindFreeSlot(const query::WindowInfo& info) const;
+  void InsertTemplateNode(int index, Tree::NodePtr node);
+  void DfsTileTemplateHelper(int index, int x, int y, int w, int h, int border_width,
+                             int gap_width) const;
+
   Display* dpy_;
   Window root_window_;
   Config* config_;
@@ -83,6 +142,12 @@ class Workspace {
   int id_;
   std::string name_;
   bool is_fullscreen_;
+
+  // The layout template being filled in, and the tree node of each of its
+  // nodes (nullptr if it hasn't been inserted yet).
+  LayoutTemplate layout_template_;
+  std::vector<Tree::Node*> template_nodes_;
+  int free_slot_count_;
 };
 
 }  // namespace wmderland